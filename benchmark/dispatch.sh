@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# Builds the interpreter once with threaded dispatch and once with the
+# portable switch, then runs every benchmark script with both.
+#
+# usage: benchmark/dispatch.sh [runs]
+
+set -e
+
+CC=${CC:-cc}
+RUNS=${1:-3}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+$CC -O2 -o "$OUT/threaded" "$ROOT"/src/*.c -lm -lpthread
+$CC -O2 -DSWITCH_DISPATCH -o "$OUT/switch" "$ROOT"/src/*.c -lm -lpthread
+
+best() {
+
+  fastest=""
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+
+    elapsed=$("$1" "$2" | tail -n 1)
+    if [ -z "$fastest" ] ||
+       awk "BEGIN { exit !($elapsed < $fastest) }"; then
+
+      fastest=$elapsed
+    fi
+    i=$((i + 1))
+  done
+  echo "$fastest"
+}
+
+# A failing run inside best() would only print an empty time, so run each
+# script once up front and let set -e stop on an error.
+for script in "$ROOT"/benchmark/*.tango; do
+
+  "$OUT/switch" "$script" > /dev/null
+  "$OUT/threaded" "$script" > /dev/null
+done
+
+printf "%-16s %12s %12s\n" "script" "switch" "threaded"
+for script in "$ROOT"/benchmark/*.tango; do
+
+  printf "%-16s %12s %12s\n" "$(basename "$script" .tango)" \
+         "$(best "$OUT/switch" "$script")" \
+         "$(best "$OUT/threaded" "$script")"
+done
@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# Builds the interpreter once with the word-at-a-time string hash and
+# once with byte-at-a-time FNV-1a, then runs the hashing benchmark with
+# both.
+#
+# usage: benchmark/hash.sh [runs]
+
+set -e
+
+CC=${CC:-cc}
+RUNS=${1:-3}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+$CC -O2 -o "$OUT/word" "$ROOT"/src/*.c -lm -lpthread
+$CC -O2 -DFNV_STRING_HASH -o "$OUT/fnv" "$ROOT"/src/*.c -lm -lpthread
+
+best() {
+
+  fastest=""
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+
+    elapsed=$("$1" "$2" | tail -n 1)
+    if [ -z "$fastest" ] ||
+       awk "BEGIN { exit !($elapsed < $fastest) }"; then
+
+      fastest=$elapsed
+    fi
+    i=$((i + 1))
+  done
+  echo "$fastest"
+}
+
+script="$ROOT/benchmark/hash.tango"
+
+# A failing run inside best() would only print an empty time, so run each
+# build once up front and let set -e stop on an error.
+"$OUT/fnv" "$script" > /dev/null
+"$OUT/word" "$script" > /dev/null
+
+printf "%-16s %12s %12s\n" "script" "fnv" "word"
+printf "%-16s %12s %12s\n" "$(basename "$script" .tango)" \
+       "$(best "$OUT/fnv" "$script")" \
+       "$(best "$OUT/word" "$script")"
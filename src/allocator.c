@@ -0,0 +1,515 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+#endif
+
+#include "allocator.h"
+
+#define BLOCK_HEADER_SIZE ALLOCATOR_CELL_SIZE(sizeof(Block))
+#define BLOCK_CELLS(cellSize) \
+  ((ALLOCATOR_BLOCK_SIZE - (int)BLOCK_HEADER_SIZE) / (cellSize))
+#define EVACUATE_OCCUPANCY 50
+
+struct SizeClass {
+  Block* available;
+  Block* blocks;
+  Block* unswept;
+};
+
+static SizeClass sizeClasses[ALLOCATOR_SIZE_CLASSES];
+static SizeClass objectClasses[ALLOCATOR_SIZE_CLASSES];
+
+static void* pagesAllocate() {
+
+#ifdef _WIN32
+  return VirtualAlloc(NULL, ALLOCATOR_BLOCK_SIZE, MEM_RESERVE | MEM_COMMIT,
+                      PAGE_READWRITE);
+#else
+  size_t size = ALLOCATOR_BLOCK_SIZE * 2;
+  char* region = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) return NULL;
+
+  char* start = (char*)(((uintptr_t)region + ALLOCATOR_BLOCK_SIZE - 1) &
+                        ~(uintptr_t)(ALLOCATOR_BLOCK_SIZE - 1));
+  size_t head = start - region;
+  size_t tail = size - head - ALLOCATOR_BLOCK_SIZE;
+  if (head > 0) munmap(region, head);
+  if (tail > 0) munmap(start + ALLOCATOR_BLOCK_SIZE, tail);
+  return start;
+#endif
+}
+
+static void pagesFree(void* pages) {
+
+#ifdef _WIN32
+  VirtualFree(pages, 0, MEM_RELEASE);
+#else
+  munmap(pages, ALLOCATOR_BLOCK_SIZE);
+#endif
+}
+
+static int trailingZeros(uint64_t word) {
+
+#ifdef __GNUC__
+  return __builtin_ctzll(word);
+#else
+  int count = 0;
+  while ((word & 1) == 0) {
+
+    word >>= 1;
+    count++;
+  }
+  return count;
+#endif
+}
+
+static bool blockFull(Block* block) {
+
+  return block->freeCells == NULL &&
+         block->unused + block->cellSize > (char*)block + ALLOCATOR_BLOCK_SIZE;
+}
+
+static void blockLink(Block* block) {
+
+  Block** head = &block->sizeClass->available;
+  block->previous = NULL;
+  block->next = *head;
+  if (*head != NULL) (*head)->previous = block;
+  *head = block;
+}
+
+static void blockUnlink(Block* block) {
+
+  if (block->previous != NULL) block->previous->next = block->next;
+  else block->sizeClass->available = block->next;
+  if (block->next != NULL) block->next->previous = block->previous;
+}
+
+static Block* blockCreate(SizeClass* sizeClass, int cellSize) {
+
+  Block* block = (Block*)pagesAllocate();
+  if (block == NULL) return NULL;
+
+  block->sizeClass = sizeClass;
+  block->freeCells = NULL;
+  block->unused = (char*)block + BLOCK_HEADER_SIZE;
+  block->cellSize = cellSize;
+  block->liveCount = 0;
+  block->isSwept = true;
+  block->isEvacuating = false;
+  memset(block->allocated, 0, sizeof(block->allocated));
+  memset(block->marks, 0, sizeof(block->marks));
+
+  block->previousBlock = NULL;
+  block->nextBlock = sizeClass->blocks;
+  if (sizeClass->blocks != NULL) sizeClass->blocks->previousBlock = block;
+  sizeClass->blocks = block;
+
+  blockLink(block);
+  return block;
+}
+
+static void blockRelease(Block* block) {
+
+  SizeClass* sizeClass = block->sizeClass;
+  if (sizeClass->unswept == block) sizeClass->unswept = block->nextBlock;
+
+  if (block->previousBlock != NULL) {
+
+    block->previousBlock->nextBlock = block->nextBlock;
+  }
+  else {
+
+    sizeClass->blocks = block->nextBlock;
+  }
+  if (block->nextBlock != NULL) {
+
+    block->nextBlock->previousBlock = block->previousBlock;
+  }
+
+  pagesFree(block);
+}
+
+static void blockSweep(Block* block, AllocatorFinalizer finalizer) {
+
+  block->sizeClass->unswept = block->nextBlock;
+
+  for (int i = 0; i < ALLOCATOR_BITMAP_WORDS; i++) {
+
+    uint64_t dead = block->allocated[i] & ~block->marks[i];
+    block->marks[i] = 0;
+    while (dead != 0) {
+
+      int bit = i * 64 + trailingZeros(dead);
+      dead &= dead - 1;
+      finalizer((char*)block + bit * ALLOCATOR_GRANULE);
+    }
+  }
+
+  block->isSwept = true;
+  if (block->liveCount == 0 && block->sizeClass->available != NULL) {
+
+    blockRelease(block);
+  }
+  else if (!blockFull(block)) {
+
+    blockLink(block);
+  }
+}
+
+static void* classAllocate(SizeClass* sizeClass, size_t size,
+                           AllocatorFinalizer finalizer) {
+
+  int cellSize = (int)ALLOCATOR_CELL_SIZE(size);
+  Block* block = sizeClass->available;
+  while (block == NULL && sizeClass->unswept != NULL) {
+
+    blockSweep(sizeClass->unswept, finalizer);
+    block = sizeClass->available;
+  }
+
+  if (block == NULL) {
+
+    block = blockCreate(sizeClass, cellSize);
+    if (block == NULL) return NULL;
+  }
+
+  void* cell;
+  if (block->freeCells != NULL) {
+
+    cell = block->freeCells;
+    block->freeCells = *(void**)cell;
+  }
+  else {
+
+    cell = block->unused;
+    block->unused += cellSize;
+  }
+
+  size_t bit = ALLOCATOR_BIT_OF(cell);
+  block->allocated[bit / 64] |= (uint64_t)1 << (bit % 64);
+  block->liveCount++;
+  if (blockFull(block)) blockUnlink(block);
+  return cell;
+}
+
+void* allocatorAllocate(size_t size) {
+
+  return classAllocate(&sizeClasses[ALLOCATOR_CELL_SIZE(size) / ALLOCATOR_GRANULE - 1],
+                       size, NULL);
+}
+
+void* allocatorAllocateObject(size_t size, AllocatorFinalizer finalizer) {
+
+  return classAllocate(&objectClasses[ALLOCATOR_CELL_SIZE(size) / ALLOCATOR_GRANULE - 1],
+                       size, finalizer);
+}
+
+void allocatorFree(void* pointer) {
+
+  Block* block = ALLOCATOR_BLOCK_OF(pointer);
+  bool wasFull = blockFull(block);
+
+  size_t bit = ALLOCATOR_BIT_OF(pointer);
+  block->allocated[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+  *(void**)pointer = block->freeCells;
+  block->freeCells = pointer;
+  block->liveCount--;
+
+  if (!block->isSwept) return;
+
+  if (wasFull) blockLink(block);
+  if (block->liveCount == 0 &&
+      (block->previous != NULL || block->next != NULL)) {
+
+    blockUnlink(block);
+    blockRelease(block);
+  }
+}
+
+void allocatorSweepBegin() {
+
+  for (int i = 0; i < ALLOCATOR_SIZE_CLASSES; i++) {
+
+    SizeClass* sizeClass = &objectClasses[i];
+    sizeClass->available = NULL;
+    sizeClass->unswept = sizeClass->blocks;
+    for (Block* block = sizeClass->blocks;
+         block != NULL;
+         block = block->nextBlock) {
+
+      block->isSwept = false;
+    }
+  }
+}
+
+bool allocatorSweepStep(AllocatorFinalizer finalizer) {
+
+  for (int i = 0; i < ALLOCATOR_SIZE_CLASSES; i++) {
+
+    SizeClass* sizeClass = &objectClasses[i];
+    if (sizeClass->unswept != NULL) {
+
+      blockSweep(sizeClass->unswept, finalizer);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void allocatorClearMarks() {
+
+  for (int i = 0; i < ALLOCATOR_SIZE_CLASSES; i++) {
+
+    for (Block* block = objectClasses[i].blocks;
+         block != NULL;
+         block = block->nextBlock) {
+
+      memset(block->marks, 0, sizeof(block->marks));
+    }
+  }
+}
+
+static void classFragmentation(SizeClass* sizeClass, size_t* used,
+                               size_t* total) {
+
+  for (Block* block = sizeClass->blocks;
+       block != NULL;
+       block = block->nextBlock) {
+
+    *used += (size_t)block->liveCount * block->cellSize;
+    *total += ALLOCATOR_BLOCK_SIZE;
+  }
+}
+
+int allocatorFragmentation() {
+
+  size_t used = 0;
+  size_t total = 0;
+  for (int i = 0; i < ALLOCATOR_SIZE_CLASSES; i++) {
+
+    classFragmentation(&sizeClasses[i], &used, &total);
+    classFragmentation(&objectClasses[i], &used, &total);
+  }
+
+  if (total == 0) return 0;
+  return (int)(100 - used * 100 / total);
+}
+
+// Picks the sparse blocks to evacuate and reserves enough free cells in
+// the remaining blocks, creating empty ones if needed, so that moving can
+// never run out of memory halfway through.
+static bool classEvacuateBegin(SizeClass* sizeClass) {
+
+  if (sizeClass->blocks == NULL || sizeClass->blocks->nextBlock == NULL) {
+
+    return true;
+  }
+
+  int cellSize = sizeClass->blocks->cellSize;
+  int needed = 0;
+  int reserved = 0;
+  for (Block* block = sizeClass->blocks;
+       block != NULL;
+       block = block->nextBlock) {
+
+    if (block->liveCount * 100 >=
+        BLOCK_CELLS(block->cellSize) * EVACUATE_OCCUPANCY) {
+
+      reserved += BLOCK_CELLS(block->cellSize) - block->liveCount;
+      continue;
+    }
+
+    if (!blockFull(block)) blockUnlink(block);
+    block->isEvacuating = true;
+    needed += block->liveCount;
+  }
+
+  while (reserved < needed) {
+
+    if (blockCreate(sizeClass, cellSize) == NULL) return false;
+    reserved += BLOCK_CELLS(cellSize);
+  }
+
+  return true;
+}
+
+static void classEvacuateCancel(SizeClass* sizeClass) {
+
+  for (Block* block = sizeClass->blocks;
+       block != NULL;
+       block = block->nextBlock) {
+
+    if (!block->isEvacuating) continue;
+
+    block->isEvacuating = false;
+    if (!blockFull(block)) blockLink(block);
+  }
+}
+
+bool allocatorEvacuateBegin() {
+
+  bool reserved = true;
+  for (int i = 0; i < ALLOCATOR_SIZE_CLASSES && reserved; i++) {
+
+    reserved = classEvacuateBegin(&sizeClasses[i]) &&
+               classEvacuateBegin(&objectClasses[i]);
+  }
+
+  if (reserved) return true;
+
+  for (int i = 0; i < ALLOCATOR_SIZE_CLASSES; i++) {
+
+    classEvacuateCancel(&sizeClasses[i]);
+    classEvacuateCancel(&objectClasses[i]);
+  }
+  return false;
+}
+
+static void* cellMove(Block* block, void* cell) {
+
+  void* moved = classAllocate(block->sizeClass, block->cellSize, NULL);
+  memcpy(moved, cell, block->cellSize);
+  return moved;
+}
+
+void allocatorEvacuateObjects() {
+
+  for (int i = 0; i < ALLOCATOR_SIZE_CLASSES; i++) {
+
+    for (Block* block = objectClasses[i].blocks;
+         block != NULL;
+         block = block->nextBlock) {
+
+      if (!block->isEvacuating) continue;
+
+      for (int word = 0; word < ALLOCATOR_BITMAP_WORDS; word++) {
+
+        uint64_t cells = block->allocated[word];
+        while (cells != 0) {
+
+          int bit = word * 64 + trailingZeros(cells);
+          cells &= cells - 1;
+
+          void* cell = (char*)block + bit * ALLOCATOR_GRANULE;
+          *(void**)cell = cellMove(block, cell);
+        }
+      }
+    }
+  }
+}
+
+void* allocatorRelocate(void* pointer) {
+
+  Block* block = ALLOCATOR_BLOCK_OF(pointer);
+  if (!block->isEvacuating) return pointer;
+
+  size_t bit = ALLOCATOR_BIT_OF(pointer);
+  block->marks[bit / 64] |= (uint64_t)1 << (bit % 64);
+  return cellMove(block, pointer);
+}
+
+void allocatorForEachObject(void (*visit)(void* cell)) {
+
+  for (int i = 0; i < ALLOCATOR_SIZE_CLASSES; i++) {
+
+    for (Block* block = objectClasses[i].blocks;
+         block != NULL;
+         block = block->nextBlock) {
+
+      if (block->isEvacuating) continue;
+
+      for (int word = 0; word < ALLOCATOR_BITMAP_WORDS; word++) {
+
+        uint64_t cells = block->allocated[word];
+        while (cells != 0) {
+
+          int bit = word * 64 + trailingZeros(cells);
+          cells &= cells - 1;
+          visit((char*)block + bit * ALLOCATOR_GRANULE);
+        }
+      }
+    }
+  }
+}
+
+static void classEvacuateFinish(SizeClass* sizeClass, bool isObjects) {
+
+  Block* block = sizeClass->blocks;
+  while (block != NULL) {
+
+    Block* next = block->nextBlock;
+    if (block->isEvacuating) {
+
+      block->isEvacuating = false;
+      if (isObjects) {
+
+        blockRelease(block);
+      }
+      else {
+
+        for (int word = 0; word < ALLOCATOR_BITMAP_WORDS; word++) {
+
+          uint64_t moved = block->marks[word];
+          block->marks[word] = 0;
+          block->allocated[word] &= ~moved;
+          while (moved != 0) {
+
+            void* cell = (char*)block +
+                         (word * 64 + trailingZeros(moved)) * ALLOCATOR_GRANULE;
+            moved &= moved - 1;
+            *(void**)cell = block->freeCells;
+            block->freeCells = cell;
+            block->liveCount--;
+          }
+        }
+
+        if (block->liveCount == 0) blockRelease(block);
+        else if (!blockFull(block)) blockLink(block);
+      }
+    }
+
+    block = next;
+  }
+}
+
+void allocatorEvacuateFinish() {
+
+  for (int i = 0; i < ALLOCATOR_SIZE_CLASSES; i++) {
+
+    classEvacuateFinish(&sizeClasses[i], false);
+    classEvacuateFinish(&objectClasses[i], true);
+  }
+}
+
+static void classFree(SizeClass* sizeClass) {
+
+  Block* block = sizeClass->blocks;
+  while (block != NULL) {
+
+    Block* next = block->nextBlock;
+    if (block->liveCount == 0) {
+
+      if (block->isSwept && !blockFull(block)) blockUnlink(block);
+      blockRelease(block);
+    }
+    block = next;
+  }
+}
+
+void freeAllocator() {
+
+  for (int i = 0; i < ALLOCATOR_SIZE_CLASSES; i++) {
+
+    classFree(&sizeClasses[i]);
+    classFree(&objectClasses[i]);
+  }
+}
@@ -0,0 +1,101 @@
+#ifndef tango_allocator_h
+#define tango_allocator_h
+
+#include "util.h"
+
+#define ALLOCATOR_BLOCK_SIZE (64 * 1024)
+#define ALLOCATOR_GRANULE 8
+#define ALLOCATOR_MAX_SIZE 256
+#define ALLOCATOR_SIZE_CLASSES (ALLOCATOR_MAX_SIZE / ALLOCATOR_GRANULE)
+#define ALLOCATOR_BITMAP_WORDS (ALLOCATOR_BLOCK_SIZE / ALLOCATOR_GRANULE / 64)
+
+#define ALLOCATOR_CELL_SIZE(size) \
+  (((size) + ALLOCATOR_GRANULE - 1) & ~(size_t)(ALLOCATOR_GRANULE - 1))
+
+#define ALLOCATOR_BLOCK_OF(pointer) \
+  ((Block*)((uintptr_t)(pointer) & ~(uintptr_t)(ALLOCATOR_BLOCK_SIZE - 1)))
+
+#define ALLOCATOR_BIT_OF(pointer) \
+  (((uintptr_t)(pointer) & (ALLOCATOR_BLOCK_SIZE - 1)) / ALLOCATOR_GRANULE)
+
+typedef struct SizeClass SizeClass;
+
+typedef struct Block {
+  struct Block* next;
+  struct Block* previous;
+  struct Block* nextBlock;
+  struct Block* previousBlock;
+  SizeClass* sizeClass;
+  void* freeCells;
+  char* unused;
+  int cellSize;
+  int liveCount;
+  bool isSwept;
+  bool isEvacuating;
+  uint64_t allocated[ALLOCATOR_BITMAP_WORDS];
+  uint64_t marks[ALLOCATOR_BITMAP_WORDS];
+} Block;
+
+typedef void (*AllocatorFinalizer)(void* cell);
+
+void* allocatorAllocate(size_t size);
+void* allocatorAllocateObject(size_t size, AllocatorFinalizer finalizer);
+void allocatorFree(void* pointer);
+void allocatorSweepBegin();
+bool allocatorSweepStep(AllocatorFinalizer finalizer);
+void allocatorClearMarks();
+int allocatorFragmentation();
+bool allocatorEvacuateBegin();
+void allocatorEvacuateObjects();
+void* allocatorRelocate(void* pointer);
+void allocatorForEachObject(void (*visit)(void* cell));
+void allocatorEvacuateFinish();
+void freeAllocator();
+
+static inline bool allocatorIsEvacuating(void* pointer) {
+
+  return ALLOCATOR_BLOCK_OF(pointer)->isEvacuating;
+}
+
+static inline bool allocatorIsMarked(void* pointer) {
+
+  Block* block = ALLOCATOR_BLOCK_OF(pointer);
+  size_t bit = ALLOCATOR_BIT_OF(pointer);
+  return (block->marks[bit / 64] >> (bit % 64)) & 1;
+}
+
+static inline bool allocatorMark(void* pointer) {
+
+  Block* block = ALLOCATOR_BLOCK_OF(pointer);
+  size_t bit = ALLOCATOR_BIT_OF(pointer);
+  uint64_t mask = (uint64_t)1 << (bit % 64);
+  if (block->marks[bit / 64] & mask) return false;
+
+  block->marks[bit / 64] |= mask;
+  return true;
+}
+
+#ifdef PARALLEL_MARKING
+static inline bool allocatorMarkAtomic(void* pointer) {
+
+  Block* block = ALLOCATOR_BLOCK_OF(pointer);
+  size_t bit = ALLOCATOR_BIT_OF(pointer);
+  uint64_t mask = (uint64_t)1 << (bit % 64);
+  if (__atomic_load_n(&block->marks[bit / 64], __ATOMIC_RELAXED) & mask) {
+
+    return false;
+  }
+
+  return !(__atomic_fetch_or(&block->marks[bit / 64], mask,
+                             __ATOMIC_RELAXED) & mask);
+}
+#endif
+
+static inline void allocatorUnmark(void* pointer) {
+
+  Block* block = ALLOCATOR_BLOCK_OF(pointer);
+  size_t bit = ALLOCATOR_BIT_OF(pointer);
+  block->marks[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+}
+
+#endif
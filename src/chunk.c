@@ -11,6 +11,12 @@ void initChunk(Chunk* chunk) {
   chunk->code = NULL;
   chunk->lines = NULL;
   initValueArray(&chunk->constants);
+  chunk->cacheCount = 0;
+  chunk->cacheSize = 0;
+  chunk->caches = NULL;
+  chunk->calleeCount = 0;
+  chunk->calleeSize = 0;
+  chunk->callees = NULL;
 }
 
 void freeChunk(Chunk* chunk) {
@@ -18,6 +24,8 @@ void freeChunk(Chunk* chunk) {
   FREE_ARRAY(uint8_t, chunk->code, chunk->size);
   FREE_ARRAY(int, chunk->lines, chunk->size);
   freeValueArray(&chunk->constants);
+  FREE_ARRAY(InlineCache, chunk->caches, chunk->cacheSize);
+  FREE_ARRAY(Value, chunk->callees, chunk->calleeSize);
   initChunk(chunk);
 }
 
@@ -44,4 +52,41 @@ int addConstant(Chunk* chunk, Value value) {
   writeValueArray(&chunk->constants, value);
   stackPop();
   return chunk->constants.count -1;
+}
+
+int addInlineCache(Chunk* chunk) {
+
+  if (chunk->cacheSize < chunk->cacheCount + 1) {
+
+    int oldSize = chunk->cacheSize;
+    chunk->cacheSize = INCREASE_SIZE(oldSize);
+    chunk->caches = GROW_ARRAY(InlineCache, chunk->caches,
+                               oldSize, chunk->cacheSize);
+  }
+
+  InlineCache* cache = &chunk->caches[chunk->cacheCount];
+  for (int i = 0; i < INLINE_CACHE_ENTRIES; i++) {
+
+    cache->entries[i].shape = NULL;
+    cache->entries[i].transition = NULL;
+    cache->entries[i].index = -1;
+    cache->entries[i].method = NIL_VAL;
+  }
+  cache->next = 0;
+
+  return chunk->cacheCount++;
+}
+
+int addCalleeCache(Chunk* chunk) {
+
+  if (chunk->calleeSize < chunk->calleeCount + 1) {
+
+    int oldSize = chunk->calleeSize;
+    chunk->calleeSize = INCREASE_SIZE(oldSize);
+    chunk->callees = GROW_ARRAY(Value, chunk->callees,
+                                oldSize, chunk->calleeSize);
+  }
+
+  chunk->callees[chunk->calleeCount] = NIL_VAL;
+  return chunk->calleeCount++;
 }
\ No newline at end of file
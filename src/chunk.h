@@ -9,6 +9,7 @@ typedef enum {
 
   OPERATION_POP,
   OPERATION_CONSTANT,
+  OPERATION_CONSTANT_LONG,
 
   OPERATION_TRUE,
   OPERATION_FALSE,
@@ -23,50 +24,119 @@ typedef enum {
   OPERATION_DIVISION,
   OPERATION_EXPONENTIATION,
 
+  OPERATION_GREATER_NUMBERS,
+  OPERATION_LESS_NUMBERS,
+  OPERATION_ADDITION_NUMBERS,
+  OPERATION_ADDITION_STRINGS,
+  OPERATION_ADDITION_POLYMORPHIC,
+  OPERATION_SUBTRACTION_NUMBERS,
+  OPERATION_MULTIPLICATION_NUMBERS,
+  OPERATION_DIVISION_NUMBERS,
+
+  OPERATION_ADDITION_LOCALS,
+  OPERATION_LESS_LOCAL_CONSTANT,
+  OPERATION_GET_LOCAL_PROPERTY,
+
+  OPERATION_SET_LOCAL_LOCAL,
+  OPERATION_SET_LOCAL_CONSTANT,
+  OPERATION_SET_LOCAL_ADDITION,
+  OPERATION_SET_LOCAL_SUBTRACTION,
+  OPERATION_SET_LOCAL_MULTIPLICATION,
+  OPERATION_SET_LOCAL_DIVISION,
+  OPERATION_SET_LOCAL_ADDITION_CONSTANT,
+  OPERATION_SET_LOCAL_SUBTRACTION_CONSTANT,
+  OPERATION_SET_LOCAL_MULTIPLICATION_CONSTANT,
+  OPERATION_SET_LOCAL_DIVISION_CONSTANT,
+
   OPERATION_NOT,
   OPERATION_NIL,
   OPERATION_NEGATION,
 
   OPERATION_GET_LOCAL,
   OPERATION_SET_LOCAL,
-  OPERATION_GET_GLOBAL,
-  OPERATION_DEFINE_GLOBAL,
-  OPERATION_SET_GLOBAL,
+  OPERATION_GET_GLOBAL_SLOT,
+  OPERATION_GET_GLOBAL_SLOT_LONG,
+  OPERATION_DEFINE_GLOBAL_SLOT,
+  OPERATION_DEFINE_GLOBAL_SLOT_LONG,
+  OPERATION_SET_GLOBAL_SLOT,
+  OPERATION_SET_GLOBAL_SLOT_LONG,
   OPERATION_GET_UPVALUE,
   OPERATION_SET_UPVALUE,
   OPERATION_GET_PROPERTY,
+  OPERATION_GET_PROPERTY_LONG,
   OPERATION_SET_PROPERTY,
+  OPERATION_SET_PROPERTY_LONG,
   OPERATION_GET_SUPER,
+  OPERATION_GET_SUPER_LONG,
 
   OPERATION_PRINT,
   OPERATION_JUMP,
   OPERATION_JUMP_IF_FALSE,
+  OPERATION_POP_JUMP_IF_FALSE,
+  OPERATION_JUMP_IF_EQUAL,
+  OPERATION_JUMP_IF_NOT_EQUAL,
+  OPERATION_JUMP_IF_NOT_GREATER,
+  OPERATION_JUMP_IF_NOT_GREATER_EQUAL,
+  OPERATION_JUMP_IF_NOT_LESS,
+  OPERATION_JUMP_IF_NOT_LESS_EQUAL,
+  OPERATION_JUMP_IF_NOT_LESS_LOCAL_CONSTANT,
   OPERATION_LOOP,
   OPERATION_CALL,
+  OPERATION_CALL_0,
+  OPERATION_CALL_1,
+  OPERATION_CALL_2,
+  OPERATION_CALL_3,
   OPERATION_INVOKE,
+  OPERATION_INVOKE_LONG,
   OPERATION_SUPER_INVOKE,
+  OPERATION_SUPER_INVOKE_LONG,
   OPERATION_CLOSURE,
+  OPERATION_CLOSURE_LONG,
   OPERATION_CLOSE_UPVALUE,
 
   OPERATION_CLASS,
+  OPERATION_CLASS_LONG,
   OPERATION_INHERIT,
   OPERATION_BOUND_FUNCTION,
+  OPERATION_BOUND_FUNCTION_LONG,
 
   OPERATION_RETURN,
 
 } Operation;
 
+#define INLINE_CACHE_ENTRIES 4
+
+typedef struct {
+  Object* shape;
+  Object* transition;
+  int index;
+  Value method;
+} InlineCacheEntry;
+
+typedef struct {
+  InlineCacheEntry entries[INLINE_CACHE_ENTRIES];
+  int next;
+} InlineCache;
+
 typedef struct {
   int count;
   int size;
   uint8_t* code;
   int* lines;
   ValueArray constants;
+  int cacheCount;
+  int cacheSize;
+  InlineCache* caches;
+  int calleeCount;
+  int calleeSize;
+  Value* callees;
 } Chunk;
 
 void initChunk(Chunk* chunk);
 void freeChunk(Chunk* chunk);
 void writeChunk(Chunk* chunk, uint8_t byte, int line);
 int addConstant(Chunk* chunk, Value value);
+int addInlineCache(Chunk* chunk);
+int addCalleeCache(Chunk* chunk);
 
 #endif
\ No newline at end of file
@@ -11,6 +11,8 @@
   #include "debug.h"
 #endif
 
+#define PEEPHOLE_WINDOW 4
+
 typedef struct {
   Token current;
   Token previous;
@@ -71,6 +73,14 @@ typedef struct Compiler {
   int localCount;
   Upvalue upvalues[UINT8_COUNT];
   int scopeDepth;
+
+  int operations[PEEPHOLE_WINDOW];
+  int operationCount;
+  int jumpTarget;
+
+  int* constants;
+  int constantCount;
+  int constantSize;
 } Compiler;
 
 typedef struct ClassCompiler {
@@ -159,15 +169,70 @@ static void emitByte(uint8_t byte) {
   writeChunk(currentChunk(), byte, parser.previous.line);
 }
 
-static void emitBytes(uint8_t byte1, uint8_t byte2) {
+static void emitOperation(uint8_t operation) {
+
+  if (current->operationCount == PEEPHOLE_WINDOW) {
+
+    memmove(current->operations, current->operations + 1,
+            sizeof(int) * (PEEPHOLE_WINDOW - 1));
+    current->operationCount--;
+  }
+
+  current->operations[current->operationCount++] = currentChunk()->count;
+  emitByte(operation);
+}
+
+static void emitBytes(uint8_t operation, uint8_t operand) {
+
+  emitOperation(operation);
+  emitByte(operand);
+}
+
+static void emitIndexed(uint8_t operation, uint8_t longOperation, int index) {
+
+  if (index <= UINT8_MAX) {
+
+    emitBytes(operation, (uint8_t)index);
+    return;
+  }
+
+  emitOperation(longOperation);
+  emitByte((index >> 16) & 0xff);
+  emitByte((index >> 8) & 0xff);
+  emitByte(index & 0xff);
+}
+
+static uint8_t* previousOperation(int distance) {
+
+  if (distance >= current->operationCount) return NULL;
+
+  int offset = current->operations[current->operationCount - 1 - distance];
+  if (offset < current->jumpTarget) return NULL;
 
-  emitByte(byte1);
-  emitByte(byte2);
+  return &currentChunk()->code[offset];
+}
+
+static bool previousOperationIs(int distance, uint8_t operation) {
+
+  uint8_t* code = previousOperation(distance);
+  return code != NULL && code[0] == operation;
+}
+
+static void rewindOperations(int count) {
+
+  current->operationCount -= count;
+  currentChunk()->count = current->operations[current->operationCount];
+}
+
+static int markJumpTarget() {
+
+  current->jumpTarget = currentChunk()->count;
+  return current->jumpTarget;
 }
 
 static void emitLoop(int loopStart) {
 
-  emitByte(OPERATION_LOOP);
+  emitOperation(OPERATION_LOOP);
 
   int offset = currentChunk()->count - loopStart + 2;
   if (offset > UINT16_MAX) error("Loop body too large.");
@@ -178,12 +243,67 @@ static void emitLoop(int loopStart) {
 
 static int emitJump(uint8_t instruction) {
 
-  emitByte(instruction);
+  emitOperation(instruction);
   emitByte(0xff);
   emitByte(0xff);
   return currentChunk()->count - 2;
 }
 
+static int emitConditionJump() {
+
+  if (previousOperationIs(0, OPERATION_NOT)) {
+
+    uint8_t* comparison = previousOperation(1);
+    if (comparison != NULL) {
+
+      switch (comparison[0]) {
+
+        case OPERATION_EQUALITY:
+          rewindOperations(2);
+          return emitJump(OPERATION_JUMP_IF_EQUAL);
+        case OPERATION_GREATER:
+          rewindOperations(2);
+          return emitJump(OPERATION_JUMP_IF_NOT_LESS_EQUAL);
+        case OPERATION_LESS:
+          rewindOperations(2);
+          return emitJump(OPERATION_JUMP_IF_NOT_GREATER_EQUAL);
+        default: break;
+      }
+    }
+  }
+
+  uint8_t* comparison = previousOperation(0);
+  if (comparison != NULL) {
+
+    switch (comparison[0]) {
+
+      case OPERATION_EQUALITY:
+        rewindOperations(1);
+        return emitJump(OPERATION_JUMP_IF_NOT_EQUAL);
+      case OPERATION_GREATER:
+        rewindOperations(1);
+        return emitJump(OPERATION_JUMP_IF_NOT_GREATER);
+      case OPERATION_LESS:
+        rewindOperations(1);
+        return emitJump(OPERATION_JUMP_IF_NOT_LESS);
+      case OPERATION_LESS_LOCAL_CONSTANT: {
+
+        uint8_t slot = comparison[1];
+        uint8_t constant = comparison[2];
+        rewindOperations(1);
+        emitBytes(OPERATION_JUMP_IF_NOT_LESS_LOCAL_CONSTANT, slot);
+        emitByte(constant);
+        emitByte(0xff);
+        emitByte(0xff);
+        return currentChunk()->count - 2;
+      }
+      default: break;
+    }
+  }
+
+  return emitJump(OPERATION_POP_JUMP_IF_FALSE);
+}
+
 static void emitReturn() {
 
   if (current->type == TYPE_INITIALIZER) {
@@ -192,32 +312,105 @@ static void emitReturn() {
   } 
   else {
 
-    emitByte(OPERATION_NIL);
+    emitOperation(OPERATION_NIL);
   }
 
-  emitByte(OPERATION_RETURN);
+  emitOperation(OPERATION_RETURN);
 }
 
-static uint8_t makeConstant(Value value) {
+static int makeConstant(Value value) {
 
   int constant = addConstant(currentChunk(), value);
-  if (constant > UINT8_MAX) {
+  writeBarrier((Object*)current->function, value);
+  if (constant > UINT24_MAX) {
 
     error("Too many constants in one chunk.");
     return 0;
   }
 
-  return (uint8_t)constant;
+  return constant;
+}
+
+static int* findConstant(int* constants, int size, Value value) {
+
+  uint64_t hash = value * 0x9e3779b97f4a7c15u;
+  int index = (int)(hash >> 32) & (size - 1);
+  for (;;) {
+
+    int* entry = &constants[index];
+    if (*entry == -1 ||
+        currentChunk()->constants.values[*entry] == value) {
+
+      return entry;
+    }
+
+    index = (index + 1) & (size - 1);
+  }
+}
+
+static void growConstants() {
+
+  int size = INCREASE_SIZE(current->constantSize);
+  int* constants = ALLOCATE(int, size);
+  for (int i = 0; i < size; i++) {
+
+    constants[i] = -1;
+  }
+
+  for (int i = 0; i < current->constantSize; i++) {
+
+    int constant = current->constants[i];
+    if (constant == -1) continue;
+
+    Value value = currentChunk()->constants.values[constant];
+    *findConstant(constants, size, value) = constant;
+  }
+
+  FREE_ARRAY(int, current->constants, current->constantSize);
+  current->constants = constants;
+  current->constantSize = size;
+}
+
+static int internConstant(Value value) {
+
+  stackPush(value);
+  if (current->constantCount + 1 > current->constantSize * 3 / 4) {
+
+    growConstants();
+  }
+
+  int* entry = findConstant(current->constants, current->constantSize, value);
+  if (*entry == -1) {
+
+    *entry = makeConstant(value);
+    current->constantCount++;
+  }
+  stackPop();
+
+  return *entry;
+}
+
+static void emitInlineCache() {
+
+  int cache = addInlineCache(currentChunk());
+  if (cache > UINT16_MAX) {
+
+    error("Too many property accesses in one chunk.");
+  }
+
+  emitByte((cache >> 8) & 0xff);
+  emitByte(cache & 0xff);
 }
 
 static void emitConstant(Value value) {
 
-  emitBytes(OPERATION_CONSTANT, makeConstant(value));
+  emitIndexed(OPERATION_CONSTANT, OPERATION_CONSTANT_LONG,
+              internConstant(value));
 }
 
 static void patchJump(int offset) {
 
-  int jump = currentChunk()->count - offset - 2;
+  int jump = markJumpTarget() - offset - 2;
 
   if (jump > UINT16_MAX) {
 
@@ -225,7 +418,7 @@ static void patchJump(int offset) {
   }
 
   currentChunk()->code[offset] = (jump >> 8) & 0xff;
-  currentChunk()->code[offset + 1] == jump & 0xff;
+  currentChunk()->code[offset + 1] = jump & 0xff;
 }
 
 static void initCompiler(Compiler* compiler, FunctionType type) {
@@ -235,6 +428,11 @@ static void initCompiler(Compiler* compiler, FunctionType type) {
   compiler->type = type;
   compiler->localCount = 0;
   compiler->scopeDepth = 0;
+  compiler->operationCount = 0;
+  compiler->jumpTarget = 0;
+  compiler->constants = NULL;
+  compiler->constantCount = 0;
+  compiler->constantSize = 0;
   compiler->function = newFunction();
 
   current = compiler;
@@ -243,6 +441,8 @@ static void initCompiler(Compiler* compiler, FunctionType type) {
 
     current->function->name = stringCopy(parser.previous.start,
                                          parser.previous.size);
+    writeBarrier((Object*)current->function,
+                 OBJECT_VALUE(current->function->name));
   }
 
   Local* local = &current->locals[current->localCount++];
@@ -265,6 +465,7 @@ static ObjectFunction* endCompiler() {
 
   emitReturn();
   ObjectFunction* function = current->function;
+  FREE_ARRAY(int, current->constants, current->constantSize);
 
 #ifdef DEBUG_PRINT_CODE
   if (!parser.hadError) {
@@ -293,11 +494,11 @@ static void endScope() {
 
     if (current->locals[current->localCount-1].isCaptured) {
 
-      emitByte(OPERATION_CLOSE_UPVALUE);
+      emitOperation(OPERATION_CLOSE_UPVALUE);
     }
     else {
 
-      emitByte(OPERATION_POP);
+      emitOperation(OPERATION_POP);
     }
 
     current->localCount--;
@@ -305,11 +506,45 @@ static void endScope() {
 }
 
 static void expression();
+static int resolveLocal(Compiler* compiler, Token* name);
+static int resolveUpvalue(Compiler* compiler, Token* name);
 static void statement();
 static void declaration();
 static ParseRule* getRule(TokenType type);
 static void parsePrecedence(Precedence precedence);
 
+static void emitAddition() {
+
+  if (previousOperationIs(1, OPERATION_GET_LOCAL) &&
+      previousOperationIs(0, OPERATION_GET_LOCAL)) {
+
+    uint8_t a = previousOperation(1)[1];
+    uint8_t b = previousOperation(0)[1];
+    rewindOperations(2);
+    emitBytes(OPERATION_ADDITION_LOCALS, a);
+    emitByte(b);
+    return;
+  }
+
+  emitOperation(OPERATION_ADDITION);
+}
+
+static void emitLess() {
+
+  if (previousOperationIs(1, OPERATION_GET_LOCAL) &&
+      previousOperationIs(0, OPERATION_CONSTANT)) {
+
+    uint8_t slot = previousOperation(1)[1];
+    uint8_t constant = previousOperation(0)[1];
+    rewindOperations(2);
+    emitBytes(OPERATION_LESS_LOCAL_CONSTANT, slot);
+    emitByte(constant);
+    return;
+  }
+
+  emitOperation(OPERATION_LESS);
+}
+
 static void binary(bool canAssign) {
 
   TokenType operatorType = parser.previous.type;
@@ -318,17 +553,26 @@ static void binary(bool canAssign) {
 
   switch (operatorType) {
 
-    case TOKEN_BANG_EQUAL:    emitBytes(OPERATION_EQUALITY, OPERATION_NOT); break;
-    case TOKEN_IDENTITY:      emitByte(OPERATION_EQUALITY); break;
-    case TOKEN_GREATER:       emitByte(OPERATION_GREATER); break;
-    case TOKEN_GREATER_EQUAL: emitBytes(OPERATION_LESS, OPERATION_NOT); break;
-    case TOKEN_LESS:          emitByte(OPERATION_LESS); break;
-    case TOKEN_LESS_EQUAL:    emitBytes(OPERATION_GREATER, OPERATION_NOT); break;
-    case TOKEN_PLUS:          emitByte(OPERATION_ADDITION); break;
-    case TOKEN_MINUS:         emitByte(OPERATION_SUBTRACTION); break;
-    case TOKEN_STAR:          emitByte(OPERATION_MULTIPLICATION); break;
-    case TOKEN_FWD_SLASH:     emitByte(OPERATION_DIVISION); break;
-    case TOKEN_CARET:         emitByte(OPERATION_EXPONENTIATION); break;    
+    case TOKEN_BANG_EQUAL:
+      emitOperation(OPERATION_EQUALITY);
+      emitOperation(OPERATION_NOT);
+      break;
+    case TOKEN_IDENTITY:      emitOperation(OPERATION_EQUALITY); break;
+    case TOKEN_GREATER:       emitOperation(OPERATION_GREATER); break;
+    case TOKEN_GREATER_EQUAL:
+      emitOperation(OPERATION_LESS);
+      emitOperation(OPERATION_NOT);
+      break;
+    case TOKEN_LESS:          emitLess(); break;
+    case TOKEN_LESS_EQUAL:
+      emitOperation(OPERATION_GREATER);
+      emitOperation(OPERATION_NOT);
+      break;
+    case TOKEN_PLUS:          emitAddition(); break;
+    case TOKEN_MINUS:         emitOperation(OPERATION_SUBTRACTION); break;
+    case TOKEN_STAR:          emitOperation(OPERATION_MULTIPLICATION); break;
+    case TOKEN_FWD_SLASH:     emitOperation(OPERATION_DIVISION); break;
+    case TOKEN_CARET:         emitOperation(OPERATION_EXPONENTIATION); break;    
     default: return; 
   }
 }
@@ -355,36 +599,84 @@ static uint8_t argumentList() {
     return argCount;
 }
 
-static uint8_t identifierConstant(Token* name) {
+static int identifierConstant(Token* name) {
+
+    return internConstant(OBJECT_VALUE(stringCopy(name->start, name->size)));
+}
+
+static int identifierGlobal(Token* name) {
+
+  int slot = globalSlot(stringCopy(name->start, name->size));
+  if (slot > UINT24_MAX) {
+
+    error("Too many global variables.");
+    return 0;
+  }
 
-    return makeConstant(OBJECT_VALUE(stringCopy(name->start, name->size)));
+  return slot;
+}
+
+static void emitGlobal(uint8_t operation, uint8_t longOperation, int slot) {
+
+  if (slot > UINT16_MAX) {
+
+    emitOperation(longOperation);
+    emitByte((slot >> 16) & 0xff);
+  }
+  else {
+
+    emitOperation(operation);
+  }
+
+  emitByte((slot >> 8) & 0xff);
+  emitByte(slot & 0xff);
 }
 
 static void call(bool canAssign) {
 
   uint8_t argCount = argumentList();
+  if (argCount <= 3 && currentChunk()->calleeCount <= UINT16_MAX) {
+
+    int cache = addCalleeCache(currentChunk());
+    emitOperation(OPERATION_CALL_0 + argCount);
+    emitByte((cache >> 8) & 0xff);
+    emitByte(cache & 0xff);
+    return;
+  }
+
   emitBytes(OPERATION_CALL, argCount);
 }
 
 static void dot(bool canAssign) {
 
   consume(TOKEN_IDENTIFIER, "Expect property name after '.'.");
-  uint8_t name = identifierConstant(&parser.previous);
+  int name = identifierConstant(&parser.previous);
   
   if (canAssign && match(TOKEN_EQUAL)) {
 
     expression();
-    emitBytes(OPERATION_SET_PROPERTY, name);
+    emitIndexed(OPERATION_SET_PROPERTY, OPERATION_SET_PROPERTY_LONG, name);
+    emitInlineCache();
   }
   else if (match(TOKEN_LEFT_PAREN)) {
 
     uint8_t argCount = argumentList();
-    emitBytes(OPERATION_INVOKE, name);
+    emitIndexed(OPERATION_INVOKE, OPERATION_INVOKE_LONG, name);
     emitByte(argCount);
+    emitInlineCache();
+  }
+  else if (name <= UINT8_MAX && previousOperationIs(0, OPERATION_GET_LOCAL)) {
+
+    uint8_t slot = previousOperation(0)[1];
+    rewindOperations(1);
+    emitBytes(OPERATION_GET_LOCAL_PROPERTY, slot);
+    emitByte((uint8_t)name);
+    emitInlineCache();
   }
   else {
 
-    emitBytes(OPERATION_GET_PROPERTY, name);
+    emitIndexed(OPERATION_GET_PROPERTY, OPERATION_GET_PROPERTY_LONG, name);
+    emitInlineCache();
   }
 }
 
@@ -392,9 +684,9 @@ static void literal(bool canAssign) {
 
   switch (parser.previous.type) {
 
-    case TOKEN_FALSE: emitByte(OPERATION_FALSE); break;
-    case TOKEN_NIL: emitByte(OPERATION_NIL); break;
-    case TOKEN_TRUE: emitByte(OPERATION_TRUE); break;
+    case TOKEN_FALSE: emitOperation(OPERATION_FALSE); break;
+    case TOKEN_NIL: emitOperation(OPERATION_NIL); break;
+    case TOKEN_TRUE: emitOperation(OPERATION_TRUE); break;
     default: return;
   }
 }
@@ -415,7 +707,7 @@ static void and_(bool canAssign) {
 
   int endJump = emitJump(OPERATION_JUMP_IF_FALSE);
 
-  emitByte(OPERATION_POP);
+  emitOperation(OPERATION_POP);
   parsePrecedence(PRECEDENCE_AND);
   
   patchJump(endJump);
@@ -427,7 +719,7 @@ static void or_(bool canAssign) {
   int endJump = emitJump(OPERATION_JUMP);
 
   patchJump(elseJump);
-  emitByte(OPERATION_POP);
+  emitOperation(OPERATION_POP);
   
   parsePrecedence(PRECEDENCE_OR);
   patchJump(endJump);
@@ -456,9 +748,19 @@ static void namedVariable(Token name, bool canAssign) {
   }
   else {
 
-    arg = identifierConstant(&name);
-    getOp = OPERATION_GET_GLOBAL;
-    setOp = OPERATION_SET_GLOBAL;
+    int slot = identifierGlobal(&name);
+    if (canAssign && match(TOKEN_EQUAL)) {
+
+      expression();
+      emitGlobal(OPERATION_SET_GLOBAL_SLOT, OPERATION_SET_GLOBAL_SLOT_LONG,
+                 slot);
+    }
+    else {
+
+      emitGlobal(OPERATION_GET_GLOBAL_SLOT, OPERATION_GET_GLOBAL_SLOT_LONG,
+                 slot);
+    }
+    return;
   }
 
   if (canAssign && match(TOKEN_EQUAL)) {
@@ -498,20 +800,20 @@ static void super_(bool canAssign) {
 
   consume(TOKEN_DOT, "Expect '.' after 'super'.");
   consume(TOKEN_IDENTIFIER, "Expect superclass method name.");
-  uint8_t name = identifierConstant(&parser.previous);
+  int name = identifierConstant(&parser.previous);
 
   namedVariable(syntheticToken("this"), false);
   if (match(TOKEN_LEFT_PAREN)) {
 
     uint8_t argCount = argumentList();
     namedVariable(syntheticToken("super"), false);
-    emitBytes(OPERATION_SUPER_INVOKE, name);
+    emitIndexed(OPERATION_SUPER_INVOKE, OPERATION_SUPER_INVOKE_LONG, name);
     emitByte(argCount);
   } 
   else {
 
     namedVariable(syntheticToken("super"), false);
-    emitBytes(OPERATION_GET_SUPER, name);
+    emitIndexed(OPERATION_GET_SUPER, OPERATION_GET_SUPER_LONG, name);
   }
 }
 
@@ -534,21 +836,21 @@ static void unary(bool canAssign) {
 
   switch (operatorType) {
 
-    case TOKEN_BANG: emitByte(OPERATION_NOT); break;
-    case TOKEN_MINUS: emitByte(OPERATION_NEGATION); break;
+    case TOKEN_BANG: emitOperation(OPERATION_NOT); break;
+    case TOKEN_MINUS: emitOperation(OPERATION_NEGATION); break;
     default: return;
   }
 }
 
 ParseRule rules[] = {
 
-  [TOKEN_LEFT_PAREN]     = {grouping, call, PRECEDENCE_NONE},
+  [TOKEN_LEFT_PAREN]     = {grouping, call, PRECEDENCE_CALL},
   [TOKEN_RIGHT_PAREN]    = {NULL, NULL, PRECEDENCE_NONE},
   [TOKEN_LEFT_BRACE]     = {NULL, NULL, PRECEDENCE_NONE},
   [TOKEN_RIGHT_BRACE]    = {NULL, NULL, PRECEDENCE_NONE},
  
   [TOKEN_COMMA]          = {NULL, NULL, PRECEDENCE_NONE},
-  [TOKEN_DOT]            = {NULL, dot, PRECEDENCE_NONE},
+  [TOKEN_DOT]            = {NULL, dot, PRECEDENCE_CALL},
   [TOKEN_SEMICOLON]      = {NULL, NULL, PRECEDENCE_NONE},
 
   [TOKEN_PLUS]           = {NULL, binary, PRECEDENCE_TERM},
@@ -558,13 +860,13 @@ ParseRule rules[] = {
   [TOKEN_CARET]          = {NULL, binary, PRECEDENCE_FACTOR},
 
   [TOKEN_BANG]           = {unary, NULL, PRECEDENCE_NONE},
-  [TOKEN_BANG_EQUAL]     = {NULL, binary, PRECEDENCE_NONE},
+  [TOKEN_BANG_EQUAL]     = {NULL, binary, PRECEDENCE_EQUALITY},
   [TOKEN_EQUAL]          = {NULL, NULL, PRECEDENCE_NONE},
-  [TOKEN_IDENTITY]       = {NULL, binary, PRECEDENCE_NONE},
-  [TOKEN_GREATER]        = {NULL, binary, PRECEDENCE_NONE},
-  [TOKEN_GREATER_EQUAL]  = {NULL, binary, PRECEDENCE_NONE},
-  [TOKEN_LESS]           = {NULL, binary, PRECEDENCE_NONE},
-  [TOKEN_LESS_EQUAL]     = {NULL, binary, PRECEDENCE_NONE},
+  [TOKEN_IDENTITY]       = {NULL, binary, PRECEDENCE_EQUALITY},
+  [TOKEN_GREATER]        = {NULL, binary, PRECEDENCE_COMPARISON},
+  [TOKEN_GREATER_EQUAL]  = {NULL, binary, PRECEDENCE_COMPARISON},
+  [TOKEN_LESS]           = {NULL, binary, PRECEDENCE_COMPARISON},
+  [TOKEN_LESS_EQUAL]     = {NULL, binary, PRECEDENCE_COMPARISON},
 
   [TOKEN_IDENTIFIER]     = {variable, NULL, PRECEDENCE_NONE},
   [TOKEN_STRING]         = {string, NULL, PRECEDENCE_NONE},
@@ -659,8 +961,7 @@ static int addUpvalue(Compiler* compiler, uint8_t index, bool isLocal) {
   for (int i =0; i < upvalueCount; i++) {
     
     Upvalue* upvalue = &compiler->upvalues[i];
-    if (upvalue->index == index && upvalue->isLocal == isLocal) {}
-    return i;
+    if (upvalue->index == index && upvalue->isLocal == isLocal) return i;
   }
 
   if (upvalueCount == UINT8_COUNT) {
@@ -729,14 +1030,14 @@ static void declareVariable() {
   addLocal(*name);
 }
 
-static uint8_t parseVariable(const char* errorMessage) {
+static int parseVariable(const char* errorMessage) {
 
   consume(TOKEN_IDENTIFIER, errorMessage);
 
   declareVariable();
   if (current->scopeDepth > 0) return 0;
 
-  return  identifierConstant(&parser.previous);
+  return identifierGlobal(&parser.previous);
 }
 
 static void markInitialized() {
@@ -745,7 +1046,7 @@ static void markInitialized() {
   current->locals[current->localCount -1].depth = current->scopeDepth;
 }
 
-static void defineVariable(uint8_t global) {
+static void defineVariable(int global) {
 
   if (current->scopeDepth > 0) {
 
@@ -753,7 +1054,8 @@ static void defineVariable(uint8_t global) {
     return;
   }
 
-  emitBytes(OPERATION_DEFINE_GLOBAL, global);
+  emitGlobal(OPERATION_DEFINE_GLOBAL_SLOT, OPERATION_DEFINE_GLOBAL_SLOT_LONG,
+             global);
 }
 
 static void block() {
@@ -782,7 +1084,7 @@ static void function(FunctionType type) {
         errorAtCurrent("Can't have more than 255 parameters.");
       }
 
-      uint8_t constant = parseVariable("Expect parameter name.");
+      int constant = parseVariable("Expect parameter name.");
       defineVariable(constant);
     } while (match(TOKEN_COMMA));
 
@@ -792,7 +1094,8 @@ static void function(FunctionType type) {
   block();
 
   ObjectFunction* function = endCompiler();
-  emitBytes(OPERATION_CLOSURE, makeConstant(OBJECT_VALUE(function)));
+  emitIndexed(OPERATION_CLOSURE, OPERATION_CLOSURE_LONG,
+              makeConstant(OBJECT_VALUE(function)));
 
   for (int i = 0; i < function->upvalueCount; i++) {
 
@@ -805,7 +1108,7 @@ static void function(FunctionType type) {
 static void bound() {
 
   consume(TOKEN_IDENTIFIER, "Expect method name.");
-  uint8_t constant = identifierConstant(&parser.previous);
+  int constant = identifierConstant(&parser.previous);
 
   FunctionType type = TYPE_BOUND_FUNCTION;
   if (parser.previous.size == 4 &&
@@ -815,18 +1118,20 @@ static void bound() {
   }
 
   function(type);
-  emitBytes(OPERATION_BOUND_FUNCTION, constant);
+  emitIndexed(OPERATION_BOUND_FUNCTION, OPERATION_BOUND_FUNCTION_LONG,
+              constant);
 }
 
 static void classDeclaration() {
 
   consume(TOKEN_IDENTIFIER, "Expect class name.");
   Token className = parser.previous; 
-  uint8_t nameConstant = identifierConstant(&parser.previous);
+  int nameConstant = identifierConstant(&parser.previous);
   declareVariable();
 
-  emitBytes(OPERATION_CLASS, nameConstant);
-  defineVariable(nameConstant);
+  int global = current->scopeDepth > 0 ? 0 : identifierGlobal(&className);
+  emitIndexed(OPERATION_CLASS, OPERATION_CLASS_LONG, nameConstant);
+  defineVariable(global);
 
   ClassCompiler classCompiler;
   classCompiler.hasSuperclass = false;
@@ -847,7 +1152,7 @@ static void classDeclaration() {
     defineVariable(0);
 
     namedVariable(className, false);
-    emitByte(OPERATION_INHERIT);
+    emitOperation(OPERATION_INHERIT);
     classCompiler.hasSuperclass = true;
   }
 
@@ -859,7 +1164,7 @@ static void classDeclaration() {
   }
 
   consume(TOKEN_RIGHT_BRACE, "Expect '}' after class body.");
-  emitByte(OPERATION_POP);
+  emitOperation(OPERATION_POP);
   if (classCompiler.hasSuperclass) {
 
     endScope();
@@ -870,7 +1175,7 @@ static void classDeclaration() {
 
 static void funDeclaration() {
   
-  uint8_t global = parseVariable("Expect function name.");
+  int global = parseVariable("Expect function name.");
   markInitialized();
   function(TYPE_FUNCTION);
   defineVariable(global);
@@ -878,7 +1183,7 @@ static void funDeclaration() {
 
 static void varDeclaration() {
 
-  uint8_t global = parseVariable("Expect variable name.");
+  int global = parseVariable("Expect variable name.");
 
   if (match(TOKEN_EQUAL)) {
 
@@ -886,18 +1191,115 @@ static void varDeclaration() {
   }
   else {
 
-    emitByte(OPERATION_NIL);
+    emitOperation(OPERATION_NIL);
   }
   consume(TOKEN_SEMICOLON, "Expect ';' after variable declaration.");
 
   defineVariable(global);
 }
 
+// Opt-in with -DLOCAL_STORE_SUPERINSTRUCTIONS. A statement that assigns
+// to a local from a local, a constant, or a +, -, * or / of a local and a
+// local or constant is fused into one instruction that writes the slot.
+#ifdef LOCAL_STORE_SUPERINSTRUCTIONS
+static uint8_t setLocalOperation(uint8_t operation, bool constant) {
+
+  switch (operation) {
+
+    case OPERATION_ADDITION:
+      return constant ? OPERATION_SET_LOCAL_ADDITION_CONSTANT
+                      : OPERATION_SET_LOCAL_ADDITION;
+    case OPERATION_SUBTRACTION:
+      return constant ? OPERATION_SET_LOCAL_SUBTRACTION_CONSTANT
+                      : OPERATION_SET_LOCAL_SUBTRACTION;
+    case OPERATION_MULTIPLICATION:
+      return constant ? OPERATION_SET_LOCAL_MULTIPLICATION_CONSTANT
+                      : OPERATION_SET_LOCAL_MULTIPLICATION;
+    case OPERATION_DIVISION:
+      return constant ? OPERATION_SET_LOCAL_DIVISION_CONSTANT
+                      : OPERATION_SET_LOCAL_DIVISION;
+    default:
+      return OPERATION_POP;
+  }
+}
+
+static void emitSetLocal(uint8_t operation, uint8_t target, uint8_t a,
+                         uint8_t b) {
+
+  emitBytes(operation, target);
+  emitByte(a);
+  emitByte(b);
+}
+
+static bool emitLocalStoreSuperinstruction() {
+
+  if (!previousOperationIs(0, OPERATION_SET_LOCAL)) return false;
+
+  uint8_t target = previousOperation(0)[1];
+  uint8_t* operation = previousOperation(1);
+  if (operation == NULL) return false;
+
+  switch (operation[0]) {
+
+    case OPERATION_GET_LOCAL: {
+
+      uint8_t source = operation[1];
+      rewindOperations(2);
+      emitBytes(OPERATION_SET_LOCAL_LOCAL, target);
+      emitByte(source);
+      return true;
+    }
+    case OPERATION_CONSTANT: {
+
+      uint8_t constant = operation[1];
+      rewindOperations(2);
+      emitBytes(OPERATION_SET_LOCAL_CONSTANT, target);
+      emitByte(constant);
+      return true;
+    }
+    case OPERATION_ADDITION_LOCALS: {
+
+      uint8_t a = operation[1];
+      uint8_t b = operation[2];
+      rewindOperations(2);
+      emitSetLocal(OPERATION_SET_LOCAL_ADDITION, target, a, b);
+      return true;
+    }
+    default: break;
+  }
+
+  uint8_t* left = previousOperation(3);
+  uint8_t* right = previousOperation(2);
+  if (left == NULL || left[0] != OPERATION_GET_LOCAL) return false;
+
+  bool constant = right[0] == OPERATION_CONSTANT;
+  if (!constant && right[0] != OPERATION_GET_LOCAL) return false;
+
+  uint8_t superinstruction = setLocalOperation(operation[0], constant);
+  if (superinstruction == OPERATION_POP) return false;
+
+  uint8_t a = left[1];
+  uint8_t b = right[1];
+  rewindOperations(4);
+  emitSetLocal(superinstruction, target, a, b);
+  return true;
+}
+#endif
+
+static void emitDiscard() {
+
+#ifdef LOCAL_STORE_SUPERINSTRUCTIONS
+  if (emitLocalStoreSuperinstruction()) return;
+#endif
+
+  emitOperation(OPERATION_POP);
+}
+
 static void expressionStatement() {
 
   expression();
   consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
-  emitByte(OPERATION_POP);
+  emitDiscard();
 }
 
 static void forStatement() {
@@ -915,24 +1317,22 @@ static void forStatement() {
     expressionStatement();
   }
 
-  int loopStart = currentChunk()->count;
+  int loopStart = markJumpTarget();
   int exitJump = -1;
   if (!match(TOKEN_SEMICOLON)) {
 
     expression();
     consume(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
 
-    exitJump = emitJump(OPERATION_JUMP_IF_FALSE);
-    emitByte(OPERATION_POP);
+    exitJump = emitConditionJump();
   }
-  consume(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
 
   if (!match(TOKEN_RIGHT_PAREN)) {
 
     int bodyJump = emitJump(OPERATION_JUMP);
-    int incrementStart = currentChunk()->count;
+    int incrementStart = markJumpTarget();
     expression();
-    emitByte(OPERATION_POP);
+    emitDiscard();
     consume(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
     
     emitLoop(loopStart);
@@ -946,7 +1346,6 @@ static void forStatement() {
   if (exitJump != -1) {
 
     patchJump(exitJump);
-    emitByte(OPERATION_POP);
   }
 
   endScope();
@@ -957,24 +1356,27 @@ static void ifStatement() {
   consume(TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
   expression();
   consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
-  int thenJump = emitJump(OPERATION_JUMP_IF_FALSE);
-  emitByte(OPERATION_POP);
+  int thenJump = emitConditionJump();
   statement();
 
-  int elseJump = emitJump(OPERATION_JUMP);
+  if (match(TOKEN_ELSE)) {
 
-  patchJump(thenJump);
-  emitByte(OPERATION_POP);
+    int elseJump = emitJump(OPERATION_JUMP);
+    patchJump(thenJump);
+    statement();
+    patchJump(elseJump);
+  }
+  else {
 
-  if (match(TOKEN_ELSE)) statement();
-  patchJump(elseJump);
+    patchJump(thenJump);
+  }
 }
 
 static void printStatement() {
 
   expression();
   consume(TOKEN_SEMICOLON, "Expect ';' after value.");
-  emitByte(OPERATION_PRINT);
+  emitOperation(OPERATION_PRINT);
 }
 
 static void returnStatement() {
@@ -997,24 +1399,22 @@ static void returnStatement() {
 
     expression();
     consume(TOKEN_SEMICOLON, "Expect ';' after return value.");
-    emitByte(OPERATION_RETURN);
+    emitOperation(OPERATION_RETURN);
   } 
 }
 
 static void whileStatement() {
 
-  int loopStart = currentChunk()->count;
+  int loopStart = markJumpTarget();
   consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
   expression();
   consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
   
-  int exitJump = emitJump(OPERATION_JUMP_IF_FALSE);
-  emitByte(OPERATION_POP);
+  int exitJump = emitConditionJump();
   statement();
   emitLoop(loopStart);
   
   patchJump(exitJump);
-  emitByte(OPERATION_POP);
 }
 
 static void synchronize() {
@@ -1119,6 +1519,12 @@ ObjectFunction* compile(const char* input) {
   return parser.hadError ? NULL : function;
 }
 
+void compilerAbort() {
+
+  current = NULL;
+  currentClass = NULL;
+}
+
 void compilerCollectGarbage() {
 
   Compiler* compiler = current;
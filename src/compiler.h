@@ -6,5 +6,6 @@
 
 ObjectFunction* compile(const char* input);
 void compilerCollectGarbage();
+void compilerAbort();
 
 #endif
\ No newline at end of file
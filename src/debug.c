@@ -3,6 +3,12 @@
 #include "debug.h"
 #include "object.h"
 #include "value.h"
+#include "virtualmachine.h"
+
+static int simpleInstruction(const char* name, int offset);
+static int byteInstruction(const char* name, Chunk* chunk, int offset);
+static int jumpInstruction(const char* name, int sign, Chunk* chunk,
+                           int offset);
 
 void chunkDissasemble(Chunk* chunk, const char* name) {
 
@@ -24,6 +30,176 @@ static int constantInstruction(const char* name, Chunk* chunk, int offset) {
   return offset + 2;
 }
 
+static uint32_t readLong(Chunk* chunk, int offset) {
+
+  return (uint32_t)((chunk->code[offset] << 16) |
+                    (chunk->code[offset + 1] << 8) |
+                    chunk->code[offset + 2]);
+}
+
+static int constantLongInstruction(const char* name, Chunk* chunk,
+                                   int offset) {
+
+  uint32_t constant = readLong(chunk, offset + 1);
+  printf("%-16s %4d '", name, constant);
+  valuePrint(chunk->constants.values[constant]);
+  printf("'\n");
+
+  return offset + 4;
+}
+
+static int globalLongInstruction(const char* name, Chunk* chunk, int offset) {
+
+  uint32_t slot = readLong(chunk, offset + 1);
+  printf("%-16s %4d '", name, slot);
+  valuePrint(virtualmachine.globalNames.values[slot]);
+  printf("'\n");
+
+  return offset + 4;
+}
+
+static int globalInstruction(const char* name, Chunk* chunk, int offset) {
+
+  uint16_t slot = (uint16_t)(chunk->code[offset + 1] << 8);
+  slot |= chunk->code[offset + 2];
+  printf("%-16s %4d '", name, slot);
+  valuePrint(virtualmachine.globalNames.values[slot]);
+  printf("'\n");
+
+  return offset + 3;
+}
+
+static int cacheOperand(Chunk* chunk, int offset) {
+
+  uint16_t cache = (uint16_t)(chunk->code[offset] << 8);
+  cache |= chunk->code[offset + 1];
+  printf(" [cache %d]\n", cache);
+
+  return offset + 2;
+}
+
+static int propertyInstruction(const char* name, Chunk* chunk, int offset) {
+
+  uint8_t constant = chunk->code[offset + 1];
+  printf("%-16s %4d '", name, constant);
+  valuePrint(chunk->constants.values[constant]);
+  printf("'");
+
+  return cacheOperand(chunk, offset + 2);
+}
+
+static int propertyLongInstruction(const char* name, Chunk* chunk,
+                                   int offset) {
+
+  uint32_t constant = readLong(chunk, offset + 1);
+  printf("%-16s %4d '", name, constant);
+  valuePrint(chunk->constants.values[constant]);
+  printf("'");
+
+  return cacheOperand(chunk, offset + 4);
+}
+
+static int localPropertyInstruction(const char* name, Chunk* chunk,
+                                    int offset) {
+
+  uint8_t slot = chunk->code[offset + 1];
+  uint8_t constant = chunk->code[offset + 2];
+  printf("%-16s %4d %4d '", name, slot, constant);
+  valuePrint(chunk->constants.values[constant]);
+  printf("'");
+
+  return cacheOperand(chunk, offset + 3);
+}
+
+static int invokeCacheInstruction(const char* name, Chunk* chunk,
+                                  int offset) {
+
+  uint8_t constant = chunk->code[offset + 1];
+  uint8_t argCount = chunk->code[offset + 2];
+  printf("%-16s (%d args) %4d '", name, argCount, constant);
+  valuePrint(chunk->constants.values[constant]);
+  printf("'");
+
+  return cacheOperand(chunk, offset + 3);
+}
+
+static int invokeCacheLongInstruction(const char* name, Chunk* chunk,
+                                      int offset) {
+
+  uint32_t constant = readLong(chunk, offset + 1);
+  uint8_t argCount = chunk->code[offset + 4];
+  printf("%-16s (%d args) %4d '", name, argCount, constant);
+  valuePrint(chunk->constants.values[constant]);
+  printf("'");
+
+  return cacheOperand(chunk, offset + 5);
+}
+
+static int callCacheInstruction(const char* name, Chunk* chunk,
+                                int offset) {
+
+  printf("%-16s", name);
+  return cacheOperand(chunk, offset + 1);
+}
+
+static int localsInstruction(const char* name, Chunk* chunk, int offset) {
+
+  uint8_t a = chunk->code[offset + 1];
+  uint8_t b = chunk->code[offset + 2];
+  printf("%-16s %4d %4d\n", name, a, b);
+
+  return offset + 3;
+}
+
+static int localConstantInstruction(const char* name, Chunk* chunk,
+                                    int offset) {
+
+  uint8_t slot = chunk->code[offset + 1];
+  uint8_t constant = chunk->code[offset + 2];
+  printf("%-16s %4d %4d '", name, slot, constant);
+  valuePrint(chunk->constants.values[constant]);
+  printf("'\n");
+
+  return offset + 3;
+}
+
+static int setLocalInstruction(const char* name, Chunk* chunk, int offset) {
+
+  uint8_t target = chunk->code[offset + 1];
+  uint8_t a = chunk->code[offset + 2];
+  uint8_t b = chunk->code[offset + 3];
+  printf("%-16s %4d %4d %4d\n", name, target, a, b);
+
+  return offset + 4;
+}
+
+static int setLocalConstantInstruction(const char* name, Chunk* chunk,
+                                       int offset) {
+
+  uint8_t target = chunk->code[offset + 1];
+  uint8_t a = chunk->code[offset + 2];
+  uint8_t constant = chunk->code[offset + 3];
+  printf("%-16s %4d %4d %4d '", name, target, a, constant);
+  valuePrint(chunk->constants.values[constant]);
+  printf("'\n");
+
+  return offset + 4;
+}
+
+static int localConstantJumpInstruction(const char* name, Chunk* chunk,
+                                        int offset) {
+
+  uint8_t slot = chunk->code[offset + 1];
+  uint8_t constant = chunk->code[offset + 2];
+  uint16_t jump = (uint16_t)(chunk->code[offset + 3] << 8);
+  jump |= chunk->code[offset + 4];
+  printf("%-16s %4d %4d '", name, slot, constant);
+  valuePrint(chunk->constants.values[constant]);
+  printf("' %4d -> %d\n", offset, offset + 5 + jump);
+
+  return offset + 5;
+}
+
 static int invokeInstruction(const char* name, Chunk* chunk,
                              int offset) {
                               
@@ -36,6 +212,18 @@ static int invokeInstruction(const char* name, Chunk* chunk,
   return offset + 3;
 }
 
+static int invokeLongInstruction(const char* name, Chunk* chunk,
+                                 int offset) {
+
+  uint32_t constant = readLong(chunk, offset + 1);
+  uint8_t argCount = chunk->code[offset + 4];
+  printf("%-16s (%d args) %4d '", name, argCount, constant);
+  valuePrint(chunk->constants.values[constant]);
+  printf("'\n");
+
+  return offset + 5;
+}
+
 
 int instructionDissasemble(Chunk* chunk, int offset) {
      
@@ -56,6 +244,10 @@ int instructionDissasemble(Chunk* chunk, int offset) {
 
       return constantInstruction("OP_CONSTANT", chunk, offset);
     
+        case OPERATION_CONSTANT_LONG:
+
+      return constantLongInstruction("OP_CONSTANT_LONG", chunk, offset);
+    
         case OPERATION_NIL:
 
       return simpleInstruction("OP_NIL", offset);
@@ -80,17 +272,29 @@ int instructionDissasemble(Chunk* chunk, int offset) {
 
       return byteInstruction("OP_SET_LOCAL", chunk, offset);
     
-        case OPERATION_GET_GLOBAL:
+        case OPERATION_GET_GLOBAL_SLOT:
+
+      return globalInstruction("OP_GET_GLOBAL_SLOT", chunk, offset);
+    
+        case OPERATION_GET_GLOBAL_SLOT_LONG:
+
+      return globalLongInstruction("OP_GET_GLOBAL_SLOT_LONG", chunk, offset);
+    
+        case OPERATION_DEFINE_GLOBAL_SLOT:
 
-      return constantInstruction("OP_GET_GLOBAL", chunk, offset);
+      return globalInstruction("OP_DEFINE_GLOBAL_SLOT", chunk, offset);
     
-        case OPERATION_DEFINE_GLOBAL:
+        case OPERATION_DEFINE_GLOBAL_SLOT_LONG:
 
-      return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);
+      return globalLongInstruction("OP_DEFINE_GLOBAL_SLOT_LONG", chunk, offset);
     
-        case OPERATION_SET_GLOBAL:
+        case OPERATION_SET_GLOBAL_SLOT:
       
-          return constantInstruction("OP_SET_GLOBAL", chunk, offset);
+          return globalInstruction("OP_SET_GLOBAL_SLOT", chunk, offset);
+    
+        case OPERATION_SET_GLOBAL_SLOT_LONG:
+
+      return globalLongInstruction("OP_SET_GLOBAL_SLOT_LONG", chunk, offset);
     
         case OPERATION_GET_UPVALUE:
 
@@ -102,11 +306,19 @@ int instructionDissasemble(Chunk* chunk, int offset) {
     
         case OPERATION_GET_PROPERTY:
         
-      return constantInstruction("OP_GET_PROPERTY", chunk, offset);
+      return propertyInstruction("OP_GET_PROPERTY", chunk, offset);
+    
+        case OPERATION_GET_PROPERTY_LONG:
+
+      return propertyLongInstruction("OP_GET_PROPERTY_LONG", chunk, offset);
     
         case OPERATION_SET_PROPERTY:
       
-          return constantInstruction("OP_SET_PROPERTY", chunk, offset);
+          return propertyInstruction("OP_SET_PROPERTY", chunk, offset);
+    
+        case OPERATION_SET_PROPERTY_LONG:
+
+      return propertyLongInstruction("OP_SET_PROPERTY_LONG", chunk, offset);
     
         case OPERATION_EQUALITY:
 
@@ -116,6 +328,10 @@ int instructionDissasemble(Chunk* chunk, int offset) {
 
       return constantInstruction("OP_GET_SUPER", chunk, offset);
     
+        case OPERATION_GET_SUPER_LONG:
+
+      return constantLongInstruction("OP_GET_SUPER_LONG", chunk, offset);
+    
         case OPERATION_GREATER:
 
       return simpleInstruction("OP_GREATER", offset);
@@ -144,6 +360,90 @@ int instructionDissasemble(Chunk* chunk, int offset) {
 
       return simpleInstruction("OP_EXPONENTIATION", offset);
     
+        case OPERATION_GREATER_NUMBERS:
+
+      return simpleInstruction("OP_GREATER_NUMBERS", offset);
+
+        case OPERATION_LESS_NUMBERS:
+
+      return simpleInstruction("OP_LESS_NUMBERS", offset);
+
+        case OPERATION_ADDITION_NUMBERS:
+
+      return simpleInstruction("OP_ADD_NUMBERS", offset);
+
+        case OPERATION_ADDITION_STRINGS:
+
+      return simpleInstruction("OP_ADD_STRINGS", offset);
+
+        case OPERATION_ADDITION_POLYMORPHIC:
+
+      return simpleInstruction("OP_ADD_POLYMORPHIC", offset);
+
+        case OPERATION_SUBTRACTION_NUMBERS:
+
+      return simpleInstruction("OP_SUBTRACT_NUMBERS", offset);
+
+        case OPERATION_MULTIPLICATION_NUMBERS:
+
+      return simpleInstruction("OP_MULTIPLY_NUMBERS", offset);
+
+        case OPERATION_DIVISION_NUMBERS:
+
+      return simpleInstruction("OP_DIVIDE_NUMBERS", offset);
+    
+        case OPERATION_ADDITION_LOCALS:
+
+      return localsInstruction("OP_ADD_LOCALS", chunk, offset);
+
+        case OPERATION_LESS_LOCAL_CONSTANT:
+
+      return localConstantInstruction("OP_LESS_LOCAL_CONSTANT", chunk, offset);
+
+        case OPERATION_GET_LOCAL_PROPERTY:
+
+      return localPropertyInstruction("OP_GET_LOCAL_PROPERTY", chunk, offset);
+
+        case OPERATION_SET_LOCAL_LOCAL:
+
+      return localsInstruction("OP_SET_LOCAL_LOCAL", chunk, offset);
+
+        case OPERATION_SET_LOCAL_CONSTANT:
+
+      return localConstantInstruction("OP_SET_LOCAL_CONSTANT", chunk, offset);
+
+        case OPERATION_SET_LOCAL_ADDITION:
+
+      return setLocalInstruction("OP_SET_LOCAL_ADD", chunk, offset);
+
+        case OPERATION_SET_LOCAL_SUBTRACTION:
+
+      return setLocalInstruction("OP_SET_LOCAL_SUBTRACT", chunk, offset);
+
+        case OPERATION_SET_LOCAL_MULTIPLICATION:
+
+      return setLocalInstruction("OP_SET_LOCAL_MULTIPLY", chunk, offset);
+
+        case OPERATION_SET_LOCAL_DIVISION:
+
+      return setLocalInstruction("OP_SET_LOCAL_DIVIDE", chunk, offset);
+
+        case OPERATION_SET_LOCAL_ADDITION_CONSTANT:
+
+      return setLocalConstantInstruction("OP_SET_LOCAL_ADD_CONSTANT", chunk, offset);
+
+        case OPERATION_SET_LOCAL_SUBTRACTION_CONSTANT:
+
+      return setLocalConstantInstruction("OP_SET_LOCAL_SUBTRACT_CONSTANT", chunk, offset);
+
+        case OPERATION_SET_LOCAL_MULTIPLICATION_CONSTANT:
+
+      return setLocalConstantInstruction("OP_SET_LOCAL_MULTIPLY_CONSTANT", chunk, offset);
+
+        case OPERATION_SET_LOCAL_DIVISION_CONSTANT:
+
+      return setLocalConstantInstruction("OP_SET_LOCAL_DIVIDE_CONSTANT", chunk, offset);
+
         case OPERATION_NOT:
 
       return simpleInstruction("OP_NOT", offset);
@@ -163,6 +463,39 @@ int instructionDissasemble(Chunk* chunk, int offset) {
         case OPERATION_JUMP_IF_FALSE:
 
       return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
+
+        case OPERATION_POP_JUMP_IF_FALSE:
+
+      return jumpInstruction("OP_POP_JUMP_IF_FALSE", 1, chunk, offset);
+
+        case OPERATION_JUMP_IF_EQUAL:
+
+      return jumpInstruction("OP_JUMP_IF_EQUAL", 1, chunk, offset);
+
+        case OPERATION_JUMP_IF_NOT_EQUAL:
+
+      return jumpInstruction("OP_JUMP_IF_NOT_EQUAL", 1, chunk, offset);
+
+        case OPERATION_JUMP_IF_NOT_GREATER:
+
+      return jumpInstruction("OP_JUMP_IF_NOT_GREATER", 1, chunk, offset);
+
+        case OPERATION_JUMP_IF_NOT_GREATER_EQUAL:
+
+      return jumpInstruction("OP_JUMP_IF_NOT_GREATER_EQUAL", 1, chunk, offset);
+
+        case OPERATION_JUMP_IF_NOT_LESS:
+
+      return jumpInstruction("OP_JUMP_IF_NOT_LESS", 1, chunk, offset);
+
+        case OPERATION_JUMP_IF_NOT_LESS_EQUAL:
+
+      return jumpInstruction("OP_JUMP_IF_NOT_LESS_EQUAL", 1, chunk, offset);
+
+        case OPERATION_JUMP_IF_NOT_LESS_LOCAL_CONSTANT:
+
+      return localConstantJumpInstruction("OP_JUMP_IF_NOT_LESS_LOCAL_CONSTANT",
+                                          chunk, offset);
     
         case OPERATION_LOOP:
         
@@ -172,19 +505,54 @@ int instructionDissasemble(Chunk* chunk, int offset) {
 
       return byteInstruction("OP_CALL", chunk, offset);
     
+        case OPERATION_CALL_0:
+
+      return callCacheInstruction("OP_CALL_0", chunk, offset);
+    
+        case OPERATION_CALL_1:
+
+      return callCacheInstruction("OP_CALL_1", chunk, offset);
+    
+        case OPERATION_CALL_2:
+
+      return callCacheInstruction("OP_CALL_2", chunk, offset);
+    
+        case OPERATION_CALL_3:
+
+      return callCacheInstruction("OP_CALL_3", chunk, offset);
+    
         case OPERATION_INVOKE:
 
-      return invokeInstruction("OP_INVOKE", chunk, offset);
+      return invokeCacheInstruction("OP_INVOKE", chunk, offset);
+    
+        case OPERATION_INVOKE_LONG:
+
+      return invokeCacheLongInstruction("OP_INVOKE_LONG", chunk, offset);
     
         case OPERATION_SUPER_INVOKE:
 
       return invokeInstruction("OP_SUPER_INVOKE", chunk, offset);
     
-        case OPERATION_CLOSURE: {
+        case OPERATION_SUPER_INVOKE_LONG:
+
+      return invokeLongInstruction("OP_SUPER_INVOKE_LONG", chunk, offset);
+    
+        case OPERATION_CLOSURE:
+        case OPERATION_CLOSURE_LONG: {
+
+      uint32_t constant;
+      if (instruction == OPERATION_CLOSURE_LONG) {
+
+        constant = readLong(chunk, offset + 1);
+        offset += 4;
+      }
+      else {
 
-      offset++;
-      uint8_t constant = chunk->code[offset++];
-      printf("%-16s %4d ", "OP_CLOSURE", constant);
+        constant = chunk->code[offset + 1];
+        offset += 2;
+      }
+      printf("%-16s %4d ", instruction == OPERATION_CLOSURE_LONG
+             ? "OP_CLOSURE_LONG" : "OP_CLOSURE", constant);
       valuePrint(chunk->constants.values[constant]);
       printf("\n");
 
@@ -212,10 +580,18 @@ int instructionDissasemble(Chunk* chunk, int offset) {
 
       return constantInstruction("OP_CLASS", chunk, offset);
     
+        case OPERATION_CLASS_LONG:
+
+      return constantLongInstruction("OP_CLASS_LONG", chunk, offset);
+    
         case OPERATION_BOUND_FUNCTION:
 
       return constantInstruction("OP_METHOD", chunk, offset);
     
+        case OPERATION_BOUND_FUNCTION_LONG:
+
+      return constantLongInstruction("OP_METHOD_LONG", chunk, offset);
+    
         case OPERATION_INHERIT:
 
       return simpleInstruction("OP_INHERIT", offset);
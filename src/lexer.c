@@ -62,7 +62,7 @@ static char lookAheadAhead() {
 static bool check(char expected) {
 
     if (termination()) return false;
-    if (lexer.cursor != expected) return false;
+    if (*lexer.cursor != expected) return false;
     lexer.cursor++;
     return true;
 }
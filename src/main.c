@@ -1,3 +1,5 @@
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,8 +7,12 @@
 #include "util.h"
 #include "chunk.h"
 #include "debug.h"
+#include "memory.h"
 #include "virtualmachine.h"
 
+static bool statsEnabled = false;
+static const char* statsPath = NULL;
+
 static void repl() {
 
   char line[1024];
@@ -26,8 +32,7 @@ static void repl() {
 
 static char* fileRead(const char* path) {
   
-  FILE* file;
-  fopen_s(&file, path, "rb");
+  FILE* file = fopen(path, "rb");
   if (file == NULL) {
 
     fprintf(stderr, "Could not open file \"%s\".\n", path);
@@ -52,38 +57,206 @@ static char* fileRead(const char* path) {
     exit(74);
   }
 
-  buffer[bytesRead] = "\0";
+  buffer[bytesRead] = '\0';
 
   fclose(file);
   return buffer;
 }
 
+static void statsDump() {
+
+  if (!statsEnabled) return;
+
+  char buffer[GARBAGE_COLLECTOR_STATS_SIZE];
+  garbageCollectorStats(buffer, sizeof(buffer));
+
+  if (statsPath == NULL) {
+
+    fprintf(stderr, "%s\n", buffer);
+    return;
+  }
+
+  FILE* file = fopen(statsPath, "wb");
+  if (file == NULL) {
+
+    fprintf(stderr, "Could not open file \"%s\".\n", statsPath);
+    return;
+  }
+
+  fprintf(file, "%s\n", buffer);
+  fclose(file);
+}
+
 static void fileRun(const char* path) {
 
   char* source = fileRead(path);
   InterpretResult result = interpret(source);
   free(source);
+  statsDump();
 
   if (result == INTERPRET_ERROR_COMPILE) exit(65);
-  if (result == INTERPRET_ERROR_COMPILE) exit(70);
+  if (result == INTERPRET_ERROR_RUNTIME) exit(70);
+}
+
+static void usage() {
+
+  fprintf(stderr, "Usage: tango [--gc-slice=budget] [--gc-threads=count] "
+                  "[--gc-compact=percent] [--gc-target=percent] "
+                  "[--gc-pause=microseconds] [--heap-limit=bytes[k|m|g]] "
+                  "[--gc-stats[=path]] [path]\n");
+  exit(64);
+}
+
+static bool numberParse(const char* text, long minimum, long maximum,
+                        long* number) {
+
+  if (*text < '0' || *text > '9') return false;
+
+  char* end;
+  errno = 0;
+  long parsed = strtol(text, &end, 10);
+  if (errno == ERANGE || *end != '\0') return false;
+  if (parsed < minimum || parsed > maximum) return false;
+
+  *number = parsed;
+  return true;
+}
+
+static bool sizeParse(const char* text, size_t* size) {
+
+  if (*text < '0' || *text > '9') return false;
+
+  char* end;
+  errno = 0;
+  unsigned long long parsed = strtoull(text, &end, 10);
+  if (errno == ERANGE || parsed > SIZE_MAX) return false;
+
+  int shift = 0;
+  switch (*end) {
+
+    case '\0': break;
+    case 'g': case 'G': shift = 30; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'k': case 'K': shift = 10; end++; break;
+    default: return false;
+  }
+
+  if (*end != '\0' || parsed > (SIZE_MAX >> shift)) return false;
+
+  *size = (size_t)parsed << shift;
+  return true;
+}
+
+static void environmentInvalid(const char* name, const char* value) {
+
+  fprintf(stderr, "Invalid value \"%s\" for %s.\n", value, name);
+  exit(64);
+}
+
+static void environmentRead() {
+
+  long number;
+  const char* value = getenv("TANGO_GC_TARGET");
+  if (value != NULL) {
+
+    if (!numberParse(value, 0, 100, &number)) {
+
+      environmentInvalid("TANGO_GC_TARGET", value);
+    }
+    virtualmachine.gcTargetShare = (int)number;
+  }
+
+  value = getenv("TANGO_GC_PAUSE");
+  if (value != NULL) {
+
+    if (!numberParse(value, 0, LONG_MAX, &number)) {
+
+      environmentInvalid("TANGO_GC_PAUSE", value);
+    }
+    virtualmachine.gcPauseTarget = number;
+  }
+
+  value = getenv("TANGO_HEAP_LIMIT");
+  if (value != NULL && !sizeParse(value, &virtualmachine.heapLimit)) {
+
+    environmentInvalid("TANGO_HEAP_LIMIT", value);
+  }
 }
 
 int main(int argc, const char* argv[]) {
     
   initVirtualMachine();
+  environmentRead();
+
+  long number;
+  int arg = 1;
+  for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+
+    if (strncmp(argv[arg], "--gc-slice=", 11) == 0) {
+
+      if (!numberParse(argv[arg] + 11, 0, INT_MAX, &number)) usage();
+      virtualmachine.gcSliceBudget = (int)number;
+    }
+    else if (strncmp(argv[arg], "--gc-threads=", 13) == 0) {
+
+      if (!numberParse(argv[arg] + 13, 1, GARBAGE_COLLECTOR_MAX_MARKERS,
+                       &number)) {
+
+        usage();
+      }
+      virtualmachine.gcMarkers = (int)number;
+    }
+    else if (strncmp(argv[arg], "--gc-compact=", 13) == 0) {
+
+      if (!numberParse(argv[arg] + 13, 0, 100, &number)) usage();
+      virtualmachine.gcCompactThreshold = (int)number;
+    }
+    else if (strncmp(argv[arg], "--gc-target=", 12) == 0) {
+
+      if (!numberParse(argv[arg] + 12, 0, 100, &number)) usage();
+      virtualmachine.gcTargetShare = (int)number;
+    }
+    else if (strncmp(argv[arg], "--gc-pause=", 11) == 0) {
+
+      if (!numberParse(argv[arg] + 11, 0, LONG_MAX, &number)) usage();
+      virtualmachine.gcPauseTarget = number;
+    }
+    else if (strncmp(argv[arg], "--heap-limit=", 13) == 0) {
+
+      if (!sizeParse(argv[arg] + 13, &virtualmachine.heapLimit)) usage();
+    }
+    else if (strcmp(argv[arg], "--gc-stats") == 0) {
+
+      statsEnabled = true;
+    }
+    else if (strncmp(argv[arg], "--gc-stats=", 11) == 0) {
+
+      statsEnabled = true;
+      statsPath = argv[arg] + 11;
+    }
+    else {
+
+      usage();
+    }
+  }
+
+  if (virtualmachine.gcPauseTarget > 0 && virtualmachine.gcSliceBudget == 0) {
+
+    virtualmachine.gcSliceBudget = GARBAGE_COLLECTOR_DEFAULT_SLICE;
+  }
 
-  if (argc == 1) {
+  if (arg == argc) {
     
     repl();
+    statsDump();
   }
-  else if (argc == 2) {
+  else if (arg == argc - 1) {
 
-    fileRun(argv[1]);
+    fileRun(argv[arg]);
   }
   else {
 
-    fprintf(stderr, "Usage: clox [path]\n");
-    exit(64);
+    usage();
   }
 
   freeVirtualMachine();
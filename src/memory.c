@@ -1,53 +1,384 @@
+#define _DEFAULT_SOURCE
+
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+  #include <windows.h>
+#endif
 
+#include "allocator.h"
 #include "compiler.h"
 #include "memory.h"
 #include "virtualmachine.h"
 
+#if defined(PARALLEL_MARKING) || defined(BACKGROUND_SWEEPING)
+  #include <pthread.h>
+  #include <sched.h>
+#endif
+
 #ifdef DEBUG_LOG_GARBAGE_COLLECTION
   #include <stdio.h>
   #include "debug.h"
 #endif
 
-#define GARBAGE_COLLECTOR_HEAP_SIZE_MULTIPLIER 2
+#define GARBAGE_COLLECTOR_MIN_MULTIPLIER 1.25
+#define GARBAGE_COLLECTOR_MAX_MULTIPLIER 8.0
+#define GARBAGE_COLLECTOR_MULTIPLIER_STEP 1.25
+#define GARBAGE_COLLECTOR_MIN_SLICE 16
+#define GARBAGE_COLLECTOR_MAX_SLICE (1 << 20)
+#define GARBAGE_COLLECTOR_NURSERY_SIZE (256 * 1024)
+#define GARBAGE_COLLECTOR_STRESS_MAJOR_INTERVAL 64
+#define GARBAGE_COLLECTOR_SWEEP_BLOCKS 1
+#define GARBAGE_COLLECTOR_STEAL_SIZE 64
+
+#ifdef PARALLEL_MARKING
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  int count;
+  int capacity;
+  Object** objects;
+} Marker;
+
+static Marker markers[GARBAGE_COLLECTOR_MAX_MARKERS];
+static int markersInitialized = 0;
+static int idleMarkers;
+static __thread Marker* currentMarker = NULL;
+#endif
 
-void* reallocate(void* pointer, size_t oldSize, size_t newSize)  {
+#ifdef BACKGROUND_SWEEPING
+static pthread_t sweeper;
+static pthread_mutex_t sweeperLock;
+static bool sweeperInitialized = false;
+static bool sweeperRunning = false;
+static bool sweeperDone;
+static size_t sweptBytes;
+static __thread bool isSweeper = false;
+#endif
+
+static void collectEmergency();
+static void objectBlacken(Object* object);
+static void liveBytesRecord();
+
+static void memoryFree(void* pointer, size_t size) {
+
+  if (pointer == NULL) return;
+  if (size <= ALLOCATOR_MAX_SIZE) allocatorFree(pointer);
+  else free(pointer);
+}
+
+static void* memoryAllocate(size_t size) {
+
+  if (size <= ALLOCATOR_MAX_SIZE) return allocatorAllocate(size);
+  return malloc(size);
+}
+
+#ifdef BACKGROUND_SWEEPING
+static void allocatorLock() {
+
+  if (sweeperRunning) pthread_mutex_lock(&sweeperLock);
+}
+
+static void allocatorUnlock() {
+
+  if (sweeperRunning) pthread_mutex_unlock(&sweeperLock);
+}
+#else
+static void allocatorLock() {}
+static void allocatorUnlock() {}
+#endif
+
+// Pauses are wall-clock time: clock() would count every marker thread and
+// the background sweeper against the mutator's stall.
+static uint64_t clockMicroseconds() {
+
+#ifdef _WIN32
+  LARGE_INTEGER counter;
+  LARGE_INTEGER frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (uint64_t)(counter.QuadPart * 1000000.0 / frequency.QuadPart);
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#endif
+}
+
+static void pauseRecord(uint64_t start) {
+
+  GarbageCollectorStats* stats = &virtualmachine.gcStats;
+  double pause = (double)(clockMicroseconds() - start);
+  stats->pauses++;
+  stats->pauseTotal += pause;
+  if (pause > stats->pauseMax) stats->pauseMax = pause;
+
+  int bucket = 0;
+  for (double bound = 10; bucket < GARBAGE_COLLECTOR_PAUSE_BUCKETS - 1 &&
+                          pause >= bound; bound *= 10) {
+
+    bucket++;
+  }
+  stats->pauseHistogram[bucket]++;
+}
+
+static void collectTimed(void (*collector)()) {
+
+  uint64_t pauseStart = clockMicroseconds();
+  clock_t start = clock();
+  collector();
+
+  virtualmachine.gcTime += clock() - start;
+  pauseRecord(pauseStart);
+}
+
+static void allocationTrack(size_t oldSize, size_t newSize) {
+
+#ifdef BACKGROUND_SWEEPING
+  if (isSweeper) {
+
+    sweptBytes += oldSize - newSize;
+    return;
+  }
+#endif
 
   virtualmachine.bytesAllocated += newSize - oldSize;
-  if (newSize > oldSize) {
+  if (newSize <= oldSize) {
+
+    virtualmachine.gcStats.bytesFreed += oldSize - newSize;
+    return;
+  }
+
+  if (virtualmachine.bytesAllocated > virtualmachine.gcStats.peakBytes) {
+
+    virtualmachine.gcStats.peakBytes = virtualmachine.bytesAllocated;
+  }
+
+  virtualmachine.youngBytes += newSize - oldSize;
+  if (virtualmachine.gcPhase == GARBAGE_COLLECTOR_SWEEP) collectGarbageSlice();
 
 #ifdef DEBUG_STRESS_GARBAGE_COLLECTION
-  collectGarbage();
+  static int stressCount = 0;
+  if (virtualmachine.gcPhase == GARBAGE_COLLECTOR_MARK) {
+
+    collectGarbageSlice();
+  }
+  else if (++stressCount % GARBAGE_COLLECTOR_STRESS_MAJOR_INTERVAL == 0) {
+
+    if (virtualmachine.gcSliceBudget > 0) collectGarbageSlice();
+    else collectGarbage();
+  }
+  else {
+
+    collectYoungGarbage();
+  }
 #endif
-    
-    if (virtualmachine.bytesAllocated > virtualmachine.nextGC) {
 
-      collectGarbage();
+  if (virtualmachine.gcPhase == GARBAGE_COLLECTOR_MARK) {
+
+    collectTimed(collectGarbageSlice);
+  }
+  else if (virtualmachine.bytesAllocated > virtualmachine.nextGC) {
+
+    if (virtualmachine.gcSliceBudget > 0) collectTimed(collectGarbageSlice);
+    else collectTimed(collectGarbage);
+  }
+  else if (virtualmachine.youngBytes > GARBAGE_COLLECTOR_NURSERY_SIZE) {
+
+    collectTimed(collectYoungGarbage);
+  }
+
+  if (virtualmachine.heapLimit > 0 &&
+      virtualmachine.bytesAllocated > virtualmachine.heapLimit) {
+
+    collectTimed(collectEmergency);
+    if (virtualmachine.bytesAllocated > virtualmachine.heapLimit) {
+
+      size_t size = newSize - oldSize;
+      virtualmachine.bytesAllocated -= size;
+      virtualmachine.youngBytes -= virtualmachine.youngBytes < size
+                                       ? virtualmachine.youngBytes : size;
+      heapExhausted();
     }
   }
+}
+
+static void* memoryReallocate(void* pointer, size_t oldSize, size_t newSize) {
+
   if (newSize == 0) {
 
-    free(pointer);
+    memoryFree(pointer, oldSize);
     return NULL;
   }
 
-  void* result = realloc(pointer, newSize);
-  if (result == NULL) exit(1);
+  if (oldSize > ALLOCATOR_MAX_SIZE && newSize > ALLOCATOR_MAX_SIZE) {
+
+    return realloc(pointer, newSize);
+  }
+
+  if (oldSize > 0 &&
+      ALLOCATOR_CELL_SIZE(oldSize) == ALLOCATOR_CELL_SIZE(newSize)) {
+
+    return pointer;
+  }
+
+  void* result = memoryAllocate(newSize);
+  if (result != NULL && pointer != NULL) {
+
+    memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+    memoryFree(pointer, oldSize);
+  }
+
   return result;
 }
 
-void objectMarkGarbage(Object* object) {
-    
-  if (object == NULL) return;
-  if (object->isGarbage) return;
+void* reallocate(void* pointer, size_t oldSize, size_t newSize)  {
 
-#ifdef DEBUG_LOG_GARBAGE_COLLECTION
-  printf("%p mark ", (void*)object);
-  valuePrint(OBJECT_VALUE(object));
-  printf("\n");
+  allocationTrack(oldSize, newSize);
+
+  allocatorLock();
+  void* result = memoryReallocate(pointer, oldSize, newSize);
+  allocatorUnlock();
+
+  if (result == NULL && newSize > 0) {
+
+    collectTimed(collectEmergency);
+    allocatorLock();
+    result = memoryReallocate(pointer, oldSize, newSize);
+    allocatorUnlock();
+
+    if (result == NULL) {
+
+      virtualmachine.bytesAllocated -= newSize - oldSize;
+      heapExhausted();
+    }
+  }
+
+  return result;
+}
+
+#ifdef PARALLEL_MARKING
+static void markerPush(Marker* marker, Object* object) {
+
+  pthread_mutex_lock(&marker->lock);
+  if (marker->capacity < marker->count + 1) {
+
+    marker->capacity = INCREASE_SIZE(marker->capacity);
+    marker->objects = (Object**)realloc(marker->objects,
+                                        sizeof(Object*) * marker->capacity);
+
+    if (marker->objects == NULL) exit(1);
+  }
+
+  marker->objects[marker->count] = object;
+  __atomic_store_n(&marker->count, marker->count + 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&marker->lock);
+}
+
+static Object* markerPop(Marker* marker) {
+
+  Object* object = NULL;
+  pthread_mutex_lock(&marker->lock);
+  if (marker->count > 0) {
+
+    object = marker->objects[marker->count - 1];
+    __atomic_store_n(&marker->count, marker->count - 1, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&marker->lock);
+  return object;
+}
+
+static bool markerSteal(Marker* marker) {
+
+  int markerCount = virtualmachine.gcMarkers;
+  int self = (int)(marker - markers);
+  for (int i = 1; i < markerCount; i++) {
+
+    Marker* victim = &markers[(self + i) % markerCount];
+    if (__atomic_load_n(&victim->count, __ATOMIC_ACQUIRE) == 0) continue;
+
+    Object* stolen[GARBAGE_COLLECTOR_STEAL_SIZE];
+    int count = 0;
+    pthread_mutex_lock(&victim->lock);
+    if (victim->count > 0) {
+
+      count = (victim->count + 1) / 2;
+      if (count > GARBAGE_COLLECTOR_STEAL_SIZE) {
+
+        count = GARBAGE_COLLECTOR_STEAL_SIZE;
+      }
+
+      memcpy(stolen, victim->objects, sizeof(Object*) * count);
+      memmove(victim->objects, victim->objects + count,
+              sizeof(Object*) * (victim->count - count));
+      __atomic_store_n(&victim->count, victim->count - count,
+                       __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&victim->lock);
+
+    for (int j = 0; j < count; j++) markerPush(marker, stolen[j]);
+    if (count > 0) return true;
+  }
+
+  return false;
+}
+
+static bool markersWorking() {
+
+  for (int i = 0; i < virtualmachine.gcMarkers; i++) {
+
+    if (__atomic_load_n(&markers[i].count, __ATOMIC_ACQUIRE) > 0) return true;
+  }
+
+  return false;
+}
+
+static void* markerRun(void* argument) {
+
+  Marker* marker = (Marker*)argument;
+  currentMarker = marker;
+
+  for (;;) {
+
+    Object* object;
+    while ((object = markerPop(marker)) != NULL) objectBlacken(object);
+    if (markerSteal(marker)) continue;
+
+    __atomic_add_fetch(&idleMarkers, 1, __ATOMIC_SEQ_CST);
+    for (;;) {
+
+      if (__atomic_load_n(&idleMarkers, __ATOMIC_SEQ_CST) ==
+          virtualmachine.gcMarkers) {
+
+        currentMarker = NULL;
+        return NULL;
+      }
+
+      if (markersWorking()) {
+
+        __atomic_sub_fetch(&idleMarkers, 1, __ATOMIC_SEQ_CST);
+        break;
+      }
+
+      sched_yield();
+    }
+  }
+}
 #endif
 
-  object->isGarbage = true;
+static void grayPush(Object* object) {
+
+#ifdef PARALLEL_MARKING
+  if (currentMarker != NULL) {
+
+    markerPush(currentMarker, object);
+    return;
+  }
+#endif
 
  if (virtualmachine.grayCapacity < virtualmachine.grayCount + 1) {
     
@@ -61,11 +392,64 @@ void objectMarkGarbage(Object* object) {
   virtualmachine.grayStack[virtualmachine.grayCount++] = object;
 }
 
+void objectMarkGarbage(Object* object) {
+    
+  if (object == NULL) return;
+  if (virtualmachine.gcPhase == GARBAGE_COLLECTOR_YOUNG &&
+      objectHasFlag(object, OBJECT_HEADER_OLD)) return;
+
+#ifdef PARALLEL_MARKING
+  if (currentMarker != NULL) {
+
+    if (!allocatorMarkAtomic(object)) return;
+  }
+  else
+#endif
+  if (!allocatorMark(object)) return;
+
+#ifdef DEBUG_LOG_GARBAGE_COLLECTION
+  printf("%p mark ", (void*)object);
+  valuePrint(OBJECT_VALUE(object));
+  printf("\n");
+#endif
+
+  grayPush(object);
+}
+
 void valueMarkGarbage(Value value) {
 
   if (IS_OBJECT(value)) objectMarkGarbage(AS_OBJECT(value));
 }
 
+void rememberObject(Object* object) {
+
+  if (!objectHasFlag(object, OBJECT_HEADER_OLD) ||
+      objectHasFlag(object, OBJECT_HEADER_REMEMBERED)) return;
+
+  if (virtualmachine.rememberedCapacity < virtualmachine.rememberedCount + 1) {
+
+    virtualmachine.rememberedCapacity =
+        INCREASE_SIZE(virtualmachine.rememberedCapacity);
+    virtualmachine.rememberedSet = (Object**)realloc(
+        virtualmachine.rememberedSet,
+        sizeof(Object*) * virtualmachine.rememberedCapacity);
+
+    if (virtualmachine.rememberedSet == NULL) exit(1);
+  }
+
+  objectSetFlag(object, OBJECT_HEADER_REMEMBERED);
+  virtualmachine.rememberedSet[virtualmachine.rememberedCount++] = object;
+}
+
+void objectWriteBarrier(Object* owner) {
+
+  rememberObject(owner);
+  if (virtualmachine.gcPhase == GARBAGE_COLLECTOR_MARK && objectIsMarked(owner)) {
+
+    grayPush(owner);
+  }
+}
+
 static void arrayMarkGarbage(ValueArray* array) {
 
   for (int i = 0; i < array->count; i++) {
@@ -74,7 +458,26 @@ static void arrayMarkGarbage(ValueArray* array) {
   }
 }
 
-objectBlacken(Object* object) {
+static void cachesMarkGarbage(Chunk* chunk) {
+
+  for (int i = 0; i < chunk->cacheCount; i++) {
+
+    InlineCache* cache = &chunk->caches[i];
+    for (int j = 0; j < INLINE_CACHE_ENTRIES; j++) {
+
+      objectMarkGarbage(cache->entries[j].shape);
+      objectMarkGarbage(cache->entries[j].transition);
+      valueMarkGarbage(cache->entries[j].method);
+    }
+  }
+
+  for (int i = 0; i < chunk->calleeCount; i++) {
+
+    valueMarkGarbage(chunk->callees[i]);
+  }
+}
+
+static void objectBlacken(Object* object) {
 
 #ifdef DEBUG_LOG_GARBAGE_COLLECTION
   printf("%p blacken ", (void*)object);
@@ -82,7 +485,7 @@ objectBlacken(Object* object) {
   printf("\n");
 #endif
 
-  switch(object->type) {
+  switch(objectType(object)) {
 
     case OBJECT_BOUND_FUNCTION: {
 
@@ -95,6 +498,7 @@ objectBlacken(Object* object) {
 
       ObjectClass* cclass = (ObjectClass*)object;
       objectMarkGarbage((Object*)cclass->name);
+      objectMarkGarbage((Object*)cclass->shape);
       tableCollectGarbage(&cclass->methods);
       break;
     }
@@ -112,7 +516,26 @@ objectBlacken(Object* object) {
       
       ObjectInstance* instance = (ObjectInstance*)object;
       objectMarkGarbage((Object*)instance->cclass);
-      tableCollectGarbage(&instance->fields);
+      objectMarkGarbage((Object*)instance->shape);
+      if (instance->shape != NULL) {
+
+        for (int i = 0; i < instance->shape->count; i++) {
+
+          valueMarkGarbage(instance->fields[i]);
+        }
+      }
+      if (instance->dictionary != NULL) {
+
+        tableCollectGarbage(instance->dictionary);
+      }
+      break;
+    }
+    case OBJECT_SHAPE: {
+
+      ObjectShape* shape = (ObjectShape*)object;
+      objectMarkGarbage((Object*)shape->parent);
+      objectMarkGarbage((Object*)shape->name);
+      tableCollectGarbage(&shape->transitions);
       break;
     }
     case OBJECT_FUNCTION: {
@@ -120,6 +543,7 @@ objectBlacken(Object* object) {
       ObjectFunction* function = (ObjectFunction*)object;
       objectMarkGarbage((Object*)function->name);
       arrayMarkGarbage(&function->chunk.constants);
+      cachesMarkGarbage(&function->chunk);
       break;
     }
     case OBJECT_UPVALUE: {
@@ -127,20 +551,34 @@ objectBlacken(Object* object) {
       valueMarkGarbage(((ObjectUpvalue*)object)->closed);
       break;
     }
+    case OBJECT_STRING: {
+
+      if (objectHasFlag(object, OBJECT_HEADER_ROPE)) {
+
+        ObjectRope* rope = (ObjectRope*)object;
+        objectMarkGarbage((Object*)rope->left);
+        objectMarkGarbage((Object*)rope->right);
+      }
+      else if (objectHasFlag(object, OBJECT_HEADER_SLICE) &&
+               virtualmachine.gcPhase == GARBAGE_COLLECTOR_YOUNG) {
+
+        objectMarkGarbage((Object*)((ObjectSlice*)object)->parent);
+      }
+      break;
+    }
     case OBJECT_NATIVE_FUNCTION:
-    case OBJECT_STRING:
 
       break;
   }
 }
 
-objectFree(Object* object) {
+static void objectFree(Object* object) {
 
 #ifdef DEBUG_LOG_GARBAGE_COLLECTION
-  printf("%p free type %d\n", (void*)object, object->type);
+  printf("%p free type %d\n", (void*)object, objectType(object));
 #endif
 
-  switch (object->type) {
+  switch (objectType(object)) {
 
     case OBJECT_BOUND_FUNCTION: {
 
@@ -171,7 +609,12 @@ objectFree(Object* object) {
     case OBJECT_INSTANCE: {
 
       ObjectInstance* instance = (ObjectInstance*)object;
-      freeTable(&instance->fields);
+      FREE_ARRAY(Value, instance->fields, instance->capacity);
+      if (instance->dictionary != NULL) {
+
+        freeTable(instance->dictionary);
+        FREE(Table, instance->dictionary);
+      }
       FREE(ObjectInstance, object);
       break;
     }
@@ -180,11 +623,40 @@ objectFree(Object* object) {
       FREE(ObjectNativeFunction, object);
       break;
     }
+    case OBJECT_SHAPE: {
+
+      ObjectShape* shape = (ObjectShape*)object;
+      freeTable(&shape->transitions);
+      FREE(ObjectShape, object);
+      break;
+    }
     case OBJECT_STRING: {
 
       ObjectString* string = (ObjectString*)object;
-      FREE_ARRAY(char, string->string, string->size + 1);
-      FREE(ObjectString, object);
+      if (stringIsInline(string)) {
+
+        reallocate(object, sizeof(ObjectString) + string->size + 1, 0);
+        break;
+      }
+
+      if (objectHasFlag(object, OBJECT_HEADER_SLICE)) {
+
+        if (((ObjectSlice*)object)->parent == NULL) {
+
+          FREE_ARRAY(char, string->string, string->size + 1);
+        }
+
+        FREE(ObjectSlice, object);
+        break;
+      }
+
+      if (string->string != NULL) {
+
+        FREE_ARRAY(char, string->string, string->size + 1);
+      }
+
+      if (objectHasFlag(object, OBJECT_HEADER_ROPE)) FREE(ObjectRope, object);
+      else FREE(ObjectString, object);
       break;
     }
     case OBJECT_UPVALUE: {
@@ -195,6 +667,52 @@ objectFree(Object* object) {
   }
 }
 
+static void objectFinalize(void* cell) {
+
+  objectFree((Object*)cell);
+}
+
+static void youngPush(Object* object) {
+
+  if (virtualmachine.youngCapacity < virtualmachine.youngCount + 1) {
+
+    virtualmachine.youngCapacity = INCREASE_SIZE(virtualmachine.youngCapacity);
+    virtualmachine.youngObjects = (Object**)realloc(
+        virtualmachine.youngObjects,
+        sizeof(Object*) * virtualmachine.youngCapacity);
+
+    if (virtualmachine.youngObjects == NULL) exit(1);
+  }
+
+  virtualmachine.youngObjects[virtualmachine.youngCount++] = object;
+}
+
+Object* allocateObject(size_t size) {
+
+  allocationTrack(0, size);
+
+  allocatorLock();
+  Object* object = (Object*)allocatorAllocateObject(size, objectFinalize);
+  allocatorUnlock();
+
+  if (object == NULL) {
+
+    collectTimed(collectEmergency);
+    allocatorLock();
+    object = (Object*)allocatorAllocateObject(size, objectFinalize);
+    allocatorUnlock();
+
+    if (object == NULL) {
+
+      virtualmachine.bytesAllocated -= size;
+      heapExhausted();
+    }
+  }
+
+  youngPush(object);
+  return object;
+}
+
 static void rootsCollectGarbage() {
 
   for (Value* slot = virtualmachine.stack; slot < virtualmachine.stackTop; slot++) {
@@ -214,82 +732,919 @@ static void rootsCollectGarbage() {
     objectMarkGarbage((Object*)upvalue);
   }
 
-  tableCollectGarbage(&virtualmachine.globals);
+  tableCollectGarbage(&virtualmachine.globalSlots);
+  arrayMarkGarbage(&virtualmachine.globalNames);
+  arrayMarkGarbage(&virtualmachine.globalValues);
   compilerCollectGarbage();
   objectMarkGarbage((Object*)virtualmachine.initString);
 }
 
-static void referencesTrace() {
+#ifdef PARALLEL_MARKING
+static void referencesTraceParallel() {
 
-  while (virtualmachine.grayCount > 0) {
+  int markerCount = virtualmachine.gcMarkers;
+  for (; markersInitialized < markerCount; markersInitialized++) {
 
-    Object* object = virtualmachine.grayStack[--virtualmachine.grayCount];
-    objectBlacken(object);
+    Marker* marker = &markers[markersInitialized];
+    pthread_mutex_init(&marker->lock, NULL);
+    marker->count = 0;
+    marker->capacity = 0;
+    marker->objects = NULL;
   }
-}
 
-static void sweep() {
-  
-  Object* previous = NULL;
-  Object* object = virtualmachine.objects;
-  while (object != NULL) {
+  for (int i = 0; i < virtualmachine.grayCount; i++) {
 
-    if (object->isGarbage) {
-
-      object->isGarbage = false;
-      previous = object;
-      object = object->next;
-    } 
-    else {
+    Marker* marker = &markers[i % markerCount];
+    markerPush(marker, virtualmachine.grayStack[i]);
+  }
 
-      Object* unreached = object;
-      object = object->next;
-      if (previous != NULL) {
+  virtualmachine.grayCount = 0;
+  idleMarkers = 0;
 
-        previous->next = object;
-      } 
-      else {
+  int started = 1;
+  for (; started < markerCount; started++) {
 
-        virtualmachine.objects = object;
-      }
+    if (pthread_create(&markers[started].thread, NULL,
+                       markerRun, &markers[started]) != 0) {
 
-      objectFree(unreached);
+      __atomic_add_fetch(&idleMarkers, markerCount - started,
+                         __ATOMIC_SEQ_CST);
+      break;
     }
   }
-}
-
-void collectGarbage() {
 
-#ifdef DEBUG_LOG_GARBAGE_COLLECTION
-  printf("-- gc begin\n");
-  size_t before = virtualmachine.bytesAllocated;
+  markerRun(&markers[0]);
+  for (int i = 1; i < started; i++) pthread_join(markers[i].thread, NULL);
+}
 #endif
 
-  rootsCollectGarbage();
-  referencesTrace();
-  tableRemoveGarbage(&virtualmachine.strings);
-  sweep();
+static void referencesTrace() {
 
-  virtualmachine.nextGC = virtualmachine.bytesAllocated * GARBAGE_COLLECTOR_HEAP_SIZE_MULTIPLIER;
+#ifdef PARALLEL_MARKING
+  if (virtualmachine.gcMarkers > 1 &&
+      virtualmachine.gcPhase == GARBAGE_COLLECTOR_MARK) {
 
-#ifdef DEBUG_LOG_GARBAGE_COLLECTION
+    referencesTraceParallel();
+    return;
+  }
+#endif
+
+  while (virtualmachine.grayCount > 0) {
+
+    Object* object = virtualmachine.grayStack[--virtualmachine.grayCount];
+    objectBlacken(object);
+  }
+}
+
+static bool referencesTraceSlice(int budget) {
+
+  while (virtualmachine.grayCount > 0 && budget-- > 0) {
+
+    Object* object = virtualmachine.grayStack[--virtualmachine.grayCount];
+    objectBlacken(object);
+  }
+
+  return virtualmachine.grayCount == 0;
+}
+
+static void rememberedCollectGarbage() {
+
+  for (int i = 0; i < virtualmachine.rememberedCount; i++) {
+
+    objectBlacken(virtualmachine.rememberedSet[i]);
+  }
+}
+
+static void rememberedClear() {
+
+  for (int i = 0; i < virtualmachine.rememberedCount; i++) {
+
+    objectClearFlag(virtualmachine.rememberedSet[i], OBJECT_HEADER_REMEMBERED);
+  }
+
+  virtualmachine.rememberedCount = 0;
+}
+
+static void rememberedRemoveGarbage() {
+
+  int count = 0;
+  for (int i = 0; i < virtualmachine.rememberedCount; i++) {
+
+    Object* object = virtualmachine.rememberedSet[i];
+    if (objectIsMarked(object)) virtualmachine.rememberedSet[count++] = object;
+  }
+
+  virtualmachine.rememberedCount = count;
+}
+
+static void slicesRemoveGarbage() {
+
+  int count = 0;
+  for (int i = 0; i < virtualmachine.sliceCount; i++) {
+
+    Object* object = virtualmachine.slices[i];
+    if (((ObjectSlice*)object)->parent == NULL) continue;
+    if (objectHasFlag(object, OBJECT_HEADER_OLD) || objectIsMarked(object)) {
+
+      virtualmachine.slices[count++] = object;
+    }
+  }
+
+  virtualmachine.sliceCount = count;
+}
+
+static void slicesResolve() {
+
+  int count = 0;
+  for (int i = 0; i < virtualmachine.sliceCount; i++) {
+
+    ObjectSlice* slice = (ObjectSlice*)virtualmachine.slices[i];
+    if (slice->parent == NULL || !objectIsMarked((Object*)slice)) continue;
+
+    if (!objectIsMarked((Object*)slice->parent)) {
+
+      ObjectString* string = &slice->string;
+      char* chars = (char*)memoryAllocate(string->size + 1);
+      if (chars != NULL) {
+
+        memcpy(chars, string->string, string->size);
+        chars[string->size] = '\0';
+
+        // Counted like any other allocation, but exempt from the heap limit:
+        // marking can't stop for an emergency collection here, and sweeping
+        // the parent frees more than the copy takes.
+        virtualmachine.bytesAllocated += string->size + 1;
+        if (virtualmachine.bytesAllocated > virtualmachine.gcStats.peakBytes) {
+
+          virtualmachine.gcStats.peakBytes = virtualmachine.bytesAllocated;
+        }
+
+        string->string = chars;
+        slice->parent = NULL;
+        continue;
+      }
+
+      allocatorMark(slice->parent);
+    }
+
+    virtualmachine.slices[count++] = (Object*)slice;
+  }
+
+  virtualmachine.sliceCount = count;
+}
+
+static void sweepYoung() {
+
+  for (int i = 0; i < virtualmachine.youngCount; i++) {
+
+    Object* object = virtualmachine.youngObjects[i];
+    if (objectIsMarked(object)) {
+
+      allocatorUnmark(object);
+      objectSetFlag(object, OBJECT_HEADER_OLD);
+    }
+    else {
+
+      if (objectHasFlag(object, OBJECT_HEADER_INTERNED)) {
+
+        tableRemoveValue(&virtualmachine.strings, (ObjectString*)object);
+      }
+
+      objectFree(object);
+    }
+  }
+
+  virtualmachine.youngCount = 0;
+  virtualmachine.youngBytes = 0;
+}
+
+static void youngRemoveGarbage() {
+
+  int count = 0;
+  for (int i = 0; i < virtualmachine.youngCount; i++) {
+
+    Object* object = virtualmachine.youngObjects[i];
+    if (objectIsMarked(object)) virtualmachine.youngObjects[count++] = object;
+  }
+
+  virtualmachine.youngCount = count;
+}
+
+#ifdef BACKGROUND_SWEEPING
+static void* sweeperRun(void* argument) {
+
+  isSweeper = true;
+  for (;;) {
+
+    pthread_mutex_lock(&sweeperLock);
+    bool swept = allocatorSweepStep(objectFinalize);
+    pthread_mutex_unlock(&sweeperLock);
+    if (!swept) break;
+  }
+
+  __atomic_store_n(&sweeperDone, true, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static void sweeperStart() {
+
+  if (!sweeperInitialized) {
+
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&sweeperLock, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+    sweeperInitialized = true;
+  }
+
+  sweeperDone = false;
+  sweptBytes = 0;
+  sweeperRunning = true;
+  if (pthread_create(&sweeper, NULL, sweeperRun, NULL) != 0) {
+
+    sweeperRunning = false;
+  }
+}
+
+static void sweeperJoin() {
+
+  pthread_join(sweeper, NULL);
+  sweeperRunning = false;
+  virtualmachine.bytesAllocated -= sweptBytes;
+  virtualmachine.gcStats.bytesFreed += sweptBytes;
+  sweptBytes = 0;
+}
+#endif
+
+static void markBegin() {
+
+#ifdef DEBUG_LOG_GARBAGE_COLLECTION
+  printf("-- gc mark begin\n");
+#endif
+
+  virtualmachine.gcPhase = GARBAGE_COLLECTOR_MARK;
+  rootsCollectGarbage();
+}
+
+static void markFinish() {
+
+  virtualmachine.gcStats.majorCollections++;
+  rootsCollectGarbage();
+  referencesTrace();
+  slicesResolve();
+  tableRemoveGarbage(&virtualmachine.strings);
+  rememberedRemoveGarbage();
+  youngRemoveGarbage();
+  liveBytesRecord();
+
+  allocatorSweepBegin();
+  virtualmachine.nextGC = SIZE_MAX;
+  virtualmachine.gcPhase = GARBAGE_COLLECTOR_SWEEP;
+
+#ifdef BACKGROUND_SWEEPING
+  sweeperStart();
+#endif
+
+#ifdef DEBUG_LOG_GARBAGE_COLLECTION
+  printf("-- gc sweep begin\n");
+#endif
+}
+
+static bool sweepStep(int budget) {
+
+#ifdef BACKGROUND_SWEEPING
+  if (sweeperRunning) {
+
+    if (budget < INT_MAX && !__atomic_load_n(&sweeperDone, __ATOMIC_ACQUIRE)) {
+
+      return false;
+    }
+
+    sweeperJoin();
+  }
+#endif
+
+  while (budget-- > 0) {
+
+    if (!allocatorSweepStep(objectFinalize)) return true;
+  }
+
+  return false;
+}
+
+static void pacingUpdate() {
+
+  clock_t now = clock();
+  clock_t elapsed = now - virtualmachine.gcCycleStart;
+  if (virtualmachine.gcTargetShare > 0 && elapsed > 0) {
+
+    double share = 100.0 * virtualmachine.gcTime / elapsed;
+    if (share > virtualmachine.gcTargetShare) {
+
+      virtualmachine.gcMultiplier *= GARBAGE_COLLECTOR_MULTIPLIER_STEP;
+      if (virtualmachine.gcMultiplier > GARBAGE_COLLECTOR_MAX_MULTIPLIER) {
+
+        virtualmachine.gcMultiplier = GARBAGE_COLLECTOR_MAX_MULTIPLIER;
+      }
+    }
+    else if (share < virtualmachine.gcTargetShare / 2.0) {
+
+      virtualmachine.gcMultiplier /= GARBAGE_COLLECTOR_MULTIPLIER_STEP;
+      if (virtualmachine.gcMultiplier < GARBAGE_COLLECTOR_MIN_MULTIPLIER) {
+
+        virtualmachine.gcMultiplier = GARBAGE_COLLECTOR_MIN_MULTIPLIER;
+      }
+    }
+  }
+
+  virtualmachine.gcTime = 0;
+  virtualmachine.gcCycleStart = now;
+
+  virtualmachine.nextGC =
+      (size_t)(virtualmachine.bytesAllocated * virtualmachine.gcMultiplier);
+  if (virtualmachine.heapLimit > 0 &&
+      virtualmachine.nextGC > virtualmachine.heapLimit) {
+
+    virtualmachine.nextGC = virtualmachine.heapLimit;
+  }
+}
+
+static void pacingSlice(uint64_t start) {
+
+  if (virtualmachine.gcPauseTarget <= 0) return;
+
+  long pause = (long)(clockMicroseconds() - start);
+  if (pause > virtualmachine.gcPauseTarget) {
+
+    virtualmachine.gcSliceBudget /= 2;
+    if (virtualmachine.gcSliceBudget < GARBAGE_COLLECTOR_MIN_SLICE) {
+
+      virtualmachine.gcSliceBudget = GARBAGE_COLLECTOR_MIN_SLICE;
+    }
+  }
+  else if (pause < virtualmachine.gcPauseTarget / 4 &&
+           virtualmachine.gcSliceBudget < GARBAGE_COLLECTOR_MAX_SLICE) {
+
+    virtualmachine.gcSliceBudget *= 2;
+  }
+}
+
+static void sweepFinish() {
+
+  sweepStep(INT_MAX);
+  pacingUpdate();
+  virtualmachine.gcPhase = GARBAGE_COLLECTOR_IDLE;
+
+  if (virtualmachine.gcCompactThreshold > 0 &&
+      allocatorFragmentation() > virtualmachine.gcCompactThreshold) {
+
+    virtualmachine.compactRequested = true;
+  }
+
+#ifdef DEBUG_LOG_GARBAGE_COLLECTION
   printf("-- gc end\n");
-  printf(" collected %zu bytes (from %zu to %zu) next at %zu\n",
-         before - virtualmachine.bytesAllocated, before, 
+  printf(" %zu bytes allocated, next at %zu\n",
          virtualmachine.bytesAllocated, virtualmachine.nextGC);
 #endif
+}
+
+void collectYoungGarbage() {
+
+#ifdef DEBUG_LOG_GARBAGE_COLLECTION
+  printf("-- minor gc begin\n");
+  size_t before = virtualmachine.bytesAllocated;
+#endif
+
+  if (virtualmachine.gcPhase == GARBAGE_COLLECTOR_SWEEP) sweepFinish();
+
+  virtualmachine.gcStats.minorCollections++;
+  virtualmachine.gcPhase = GARBAGE_COLLECTOR_YOUNG;
+  rootsCollectGarbage();
+  rememberedCollectGarbage();
+  referencesTrace();
+  slicesRemoveGarbage();
+  sweepYoung();
+  rememberedClear();
+  virtualmachine.gcPhase = GARBAGE_COLLECTOR_IDLE;
+
+#ifdef DEBUG_LOG_GARBAGE_COLLECTION
+  printf("-- minor gc end\n");
+  printf(" collected %zu bytes (from %zu to %zu)\n",
+         before - virtualmachine.bytesAllocated, before,
+         virtualmachine.bytesAllocated);
+#endif
+}
+
+void collectGarbageSlice() {
 
+  switch (virtualmachine.gcPhase) {
+
+    case GARBAGE_COLLECTOR_IDLE:
+
+      markBegin();
+      break;
+
+    case GARBAGE_COLLECTOR_MARK: {
+
+      uint64_t start = clockMicroseconds();
+      if (referencesTraceSlice(virtualmachine.gcSliceBudget)) markFinish();
+      pacingSlice(start);
+      break;
+    }
+
+    case GARBAGE_COLLECTOR_SWEEP:
+
+      if (sweepStep(GARBAGE_COLLECTOR_SWEEP_BLOCKS)) sweepFinish();
+      break;
+
+    default: break;
+  }
+}
+
+void collectGarbage() {
+
+  if (virtualmachine.gcPhase == GARBAGE_COLLECTOR_SWEEP) sweepFinish();
+  if (virtualmachine.gcPhase == GARBAGE_COLLECTOR_IDLE) markBegin();
+
+  referencesTrace();
+  markFinish();
+}
+
+static void arrayForward(ValueArray* array) {
+
+  array->values = arrayRelocate(array->values, sizeof(Value) * array->size);
+  for (int i = 0; i < array->count; i++) {
+
+    array->values[i] = valueForward(array->values[i]);
+  }
+}
+
+static void chunkRelocate(Chunk* chunk) {
+
+  chunk->code = arrayRelocate(chunk->code, sizeof(uint8_t) * chunk->size);
+  chunk->lines = arrayRelocate(chunk->lines, sizeof(int) * chunk->size);
+  arrayForward(&chunk->constants);
+
+  chunk->caches = arrayRelocate(chunk->caches,
+                                sizeof(InlineCache) * chunk->cacheSize);
+  for (int i = 0; i < chunk->cacheCount; i++) {
+
+    InlineCache* cache = &chunk->caches[i];
+    for (int j = 0; j < INLINE_CACHE_ENTRIES; j++) {
+
+      cache->entries[j].shape = objectForward(cache->entries[j].shape);
+      cache->entries[j].transition =
+          objectForward(cache->entries[j].transition);
+      cache->entries[j].method = valueForward(cache->entries[j].method);
+    }
+  }
+
+  chunk->callees = arrayRelocate(chunk->callees,
+                                 sizeof(Value) * chunk->calleeSize);
+  for (int i = 0; i < chunk->calleeCount; i++) {
+
+    chunk->callees[i] = valueForward(chunk->callees[i]);
+  }
+}
+
+static void objectRelocate(void* cell) {
+
+  Object* object = (Object*)cell;
+  switch (objectType(object)) {
+
+    case OBJECT_BOUND_FUNCTION: {
+
+      ObjectBoundFunction* bound = (ObjectBoundFunction*)object;
+      bound->receiver = valueForward(bound->receiver);
+      bound->function =
+          (ObjectClosure*)objectForward((Object*)bound->function);
+      break;
+    }
+    case OBJECT_CLASS: {
+
+      ObjectClass* cclass = (ObjectClass*)object;
+      cclass->name = (ObjectString*)objectForward((Object*)cclass->name);
+      cclass->shape = (ObjectShape*)objectForward((Object*)cclass->shape);
+      tableRelocate(&cclass->methods);
+      break;
+    }
+    case OBJECT_CLOSURE: {
+
+      ObjectClosure* closure = (ObjectClosure*)object;
+      closure->function =
+          (ObjectFunction*)objectForward((Object*)closure->function);
+      closure->upvalues = arrayRelocate(
+          closure->upvalues, sizeof(ObjectUpvalue*) * closure->upvalueCount);
+      for (int i = 0; i < closure->upvalueCount; i++) {
+
+        closure->upvalues[i] =
+            (ObjectUpvalue*)objectForward((Object*)closure->upvalues[i]);
+      }
+      break;
+    }
+    case OBJECT_INSTANCE: {
+
+      ObjectInstance* instance = (ObjectInstance*)object;
+      instance->cclass =
+          (ObjectClass*)objectForward((Object*)instance->cclass);
+      instance->shape =
+          (ObjectShape*)objectForward((Object*)instance->shape);
+      instance->fields = arrayRelocate(instance->fields,
+                                       sizeof(Value) * instance->capacity);
+      if (instance->shape != NULL) {
+
+        for (int i = 0; i < instance->shape->count; i++) {
+
+          instance->fields[i] = valueForward(instance->fields[i]);
+        }
+      }
+      if (instance->dictionary != NULL) {
+
+        instance->dictionary = arrayRelocate(instance->dictionary,
+                                             sizeof(Table));
+        tableRelocate(instance->dictionary);
+      }
+      break;
+    }
+    case OBJECT_SHAPE: {
+
+      ObjectShape* shape = (ObjectShape*)object;
+      shape->parent = (ObjectShape*)objectForward((Object*)shape->parent);
+      shape->name = (ObjectString*)objectForward((Object*)shape->name);
+      tableRelocate(&shape->transitions);
+      break;
+    }
+    case OBJECT_FUNCTION: {
+
+      ObjectFunction* function = (ObjectFunction*)object;
+      function->name = (ObjectString*)objectForward((Object*)function->name);
+      chunkRelocate(&function->chunk);
+      break;
+    }
+    case OBJECT_STRING: {
+
+      ObjectString* string = (ObjectString*)object;
+      if (objectHasFlag(object, OBJECT_HEADER_SLICE)) {
+
+        ObjectSlice* slice = (ObjectSlice*)object;
+        slice->parent = (ObjectString*)objectForward((Object*)slice->parent);
+        if (slice->parent != NULL) break;
+      }
+
+      if (stringIsInline(string)) string->string = (char*)(string + 1);
+      else string->string = arrayRelocate(string->string, string->size + 1);
+
+      if (objectHasFlag(object, OBJECT_HEADER_ROPE)) {
+
+        ObjectRope* rope = (ObjectRope*)object;
+        rope->left = (ObjectString*)objectForward((Object*)rope->left);
+        rope->right = (ObjectString*)objectForward((Object*)rope->right);
+      }
+      break;
+    }
+    case OBJECT_UPVALUE: {
+
+      ObjectUpvalue* upvalue = (ObjectUpvalue*)object;
+      upvalue->closed = valueForward(upvalue->closed);
+      upvalue->next = (ObjectUpvalue*)objectForward((Object*)upvalue->next);
+      if (upvalue->location < virtualmachine.stack ||
+          upvalue->location >= virtualmachine.stack + STACK_MAX_LOAD) {
+
+        upvalue->location = &upvalue->closed;
+      }
+      break;
+    }
+    case OBJECT_NATIVE_FUNCTION:
+
+      break;
+  }
+}
+
+static void rootsRelocate() {
+
+  for (Value* slot = virtualmachine.stack; slot < virtualmachine.stackTop; slot++) {
+
+    *slot = valueForward(*slot);
+  }
+
+  for (int i = 0; i < virtualmachine.frameCount; i++) {
+
+    CallFrame* frame = &virtualmachine.frames[i];
+    frame->closure = (ObjectClosure*)objectForward((Object*)frame->closure);
+  }
+
+  virtualmachine.openUpvalues =
+      (ObjectUpvalue*)objectForward((Object*)virtualmachine.openUpvalues);
+  virtualmachine.initString =
+      (ObjectString*)objectForward((Object*)virtualmachine.initString);
+
+  tableRelocate(&virtualmachine.globalSlots);
+  tableRelocate(&virtualmachine.strings);
+  arrayForward(&virtualmachine.globalNames);
+  arrayForward(&virtualmachine.globalValues);
+
+  for (int i = 0; i < virtualmachine.youngCount; i++) {
+
+    virtualmachine.youngObjects[i] =
+        objectForward(virtualmachine.youngObjects[i]);
+  }
+
+  for (int i = 0; i < virtualmachine.rememberedCount; i++) {
+
+    virtualmachine.rememberedSet[i] =
+        objectForward(virtualmachine.rememberedSet[i]);
+  }
+
+  for (int i = 0; i < virtualmachine.sliceCount; i++) {
+
+    virtualmachine.slices[i] = objectForward(virtualmachine.slices[i]);
+  }
+}
+
+static void slicesRelocate() {
+
+  for (int i = 0; i < virtualmachine.sliceCount; i++) {
+
+    ObjectSlice* slice = (ObjectSlice*)virtualmachine.slices[i];
+    slice->string.string = slice->parent->string + slice->offset;
+  }
+}
+
+static void collectEmergency() {
+
+#ifdef DEBUG_LOG_GARBAGE_COLLECTION
+  printf("-- emergency gc\n");
+#endif
+
+  if (virtualmachine.gcPhase == GARBAGE_COLLECTOR_SWEEP) sweepFinish();
+  collectGarbage();
+  sweepFinish();
+}
+
+void compactGarbage() {
+
+  uint64_t pauseStart = clockMicroseconds();
+  clock_t start = clock();
+  if (virtualmachine.gcPhase == GARBAGE_COLLECTOR_SWEEP) sweepFinish();
+  collectGarbage();
+  sweepFinish();
+
+#ifdef DEBUG_LOG_GARBAGE_COLLECTION
+  printf("-- compact begin (%d%% fragmented)\n", allocatorFragmentation());
+#endif
+
+  size_t offsets[MAX_FRAMES];
+  for (int i = 0; i < virtualmachine.frameCount; i++) {
+
+    CallFrame* frame = &virtualmachine.frames[i];
+    offsets[i] = frame->ip - frame->closure->function->chunk.code;
+  }
+
+  // Compaction is skipped when the destination cells cannot be reserved;
+  // the heap stays fragmented but intact.
+  if (allocatorEvacuateBegin()) {
+
+    allocatorEvacuateObjects();
+    rootsRelocate();
+    allocatorForEachObject(objectRelocate);
+    slicesRelocate();
+    allocatorEvacuateFinish();
+
+    for (int i = 0; i < virtualmachine.frameCount; i++) {
+
+      CallFrame* frame = &virtualmachine.frames[i];
+      frame->ip = frame->closure->function->chunk.code + offsets[i];
+    }
+
+    virtualmachine.gcStats.compactions++;
+  }
+
+  virtualmachine.compactRequested = false;
+
+  virtualmachine.gcTime += clock() - start;
+  pauseRecord(pauseStart);
+
+#ifdef DEBUG_LOG_GARBAGE_COLLECTION
+  printf("-- compact end (%d%% fragmented)\n", allocatorFragmentation());
+#endif
+}
+
+static const char* objectTypeNames[] = {
+  [OBJECT_FUNCTION] = "function",
+  [OBJECT_BOUND_FUNCTION] = "boundFunction",
+  [OBJECT_NATIVE_FUNCTION] = "nativeFunction",
+  [OBJECT_CLASS] = "class",
+  [OBJECT_CLOSURE] = "closure",
+  [OBJECT_INSTANCE] = "instance",
+  [OBJECT_SHAPE] = "shape",
+  [OBJECT_STRING] = "string",
+  [OBJECT_UPVALUE] = "upvalue",
+};
+
+#define OBJECT_TYPE_COUNT (sizeof(objectTypeNames) / sizeof(objectTypeNames[0]))
+
+static size_t liveBytes[OBJECT_TYPE_COUNT];
+
+static size_t objectSize(Object* object) {
+
+  switch (objectType(object)) {
+
+    case OBJECT_BOUND_FUNCTION: return sizeof(ObjectBoundFunction);
+    case OBJECT_CLASS:
+
+      return sizeof(ObjectClass) +
+             sizeof(Pair) * ((ObjectClass*)object)->methods.size;
+
+    case OBJECT_CLOSURE:
+
+      return sizeof(ObjectClosure) +
+             sizeof(ObjectUpvalue*) * ((ObjectClosure*)object)->upvalueCount;
+
+    case OBJECT_FUNCTION: {
+
+      Chunk* chunk = &((ObjectFunction*)object)->chunk;
+      return sizeof(ObjectFunction) +
+             (sizeof(uint8_t) + sizeof(int)) * chunk->size +
+             sizeof(Value) * chunk->constants.size +
+             sizeof(InlineCache) * chunk->cacheSize +
+             sizeof(Value) * chunk->calleeSize;
+    }
+    case OBJECT_INSTANCE: {
+
+      ObjectInstance* instance = (ObjectInstance*)object;
+      size_t size = sizeof(ObjectInstance) + sizeof(Value) * instance->capacity;
+      if (instance->dictionary != NULL) {
+
+        size += sizeof(Table) + sizeof(Pair) * instance->dictionary->size;
+      }
+      return size;
+    }
+    case OBJECT_NATIVE_FUNCTION: return sizeof(ObjectNativeFunction);
+    case OBJECT_SHAPE:
+
+      return sizeof(ObjectShape) +
+             sizeof(Pair) * ((ObjectShape*)object)->transitions.size;
+
+    case OBJECT_STRING: {
+
+      ObjectString* string = (ObjectString*)object;
+      if (objectHasFlag(object, OBJECT_HEADER_SLICE)) {
+
+        size_t size = sizeof(ObjectSlice);
+        if (((ObjectSlice*)object)->parent == NULL) size += string->size + 1;
+        return size;
+      }
+
+      size_t size = objectHasFlag(object, OBJECT_HEADER_ROPE)
+                        ? sizeof(ObjectRope) : sizeof(ObjectString);
+      if (string->string != NULL) size += string->size + 1;
+      return size;
+    }
+
+    case OBJECT_UPVALUE: return sizeof(ObjectUpvalue);
+  }
+
+  return 0;
+}
+
+static void objectCount(void* cell) {
+
+  Object* object = (Object*)cell;
+  if (objectIsMarked(object)) {
+
+    liveBytes[objectType(object)] += objectSize(object);
+  }
+}
+
+// Called at the end of major marking, before the sweep begins, so the
+// per-type live bytes reported by gcStats() describe the heap as of the
+// last major collection and reading them never forces a sweep.
+static void liveBytesRecord() {
+
+  for (size_t i = 0; i < OBJECT_TYPE_COUNT; i++) liveBytes[i] = 0;
+  allocatorForEachObject(objectCount);
+}
+
+static bool statNameEqual(const char* statName, const char* name, int length) {
+
+  return (int)strlen(statName) == length &&
+         memcmp(statName, name, length) == 0;
+}
+
+bool garbageCollectorStat(const char* name, int length, double* value) {
+
+  GarbageCollectorStats* stats = &virtualmachine.gcStats;
+  struct {
+    const char* name;
+    double value;
+  } scalars[] = {
+    {"minorCollections", (double)stats->minorCollections},
+    {"majorCollections", (double)stats->majorCollections},
+    {"compactions", (double)stats->compactions},
+    {"pauses", (double)stats->pauses},
+    {"pauseTotalMicroseconds", stats->pauseTotal},
+    {"pauseMaxMicroseconds", stats->pauseMax},
+    {"bytesAllocated", (double)virtualmachine.bytesAllocated},
+    {"peakBytes", (double)stats->peakBytes},
+    {"bytesFreed", (double)stats->bytesFreed},
+  };
+
+  for (size_t i = 0; i < sizeof(scalars) / sizeof(scalars[0]); i++) {
+
+    if (statNameEqual(scalars[i].name, name, length)) {
+
+      *value = scalars[i].value;
+      return true;
+    }
+  }
+
+  for (size_t i = 0; i < OBJECT_TYPE_COUNT; i++) {
+
+    if (statNameEqual(objectTypeNames[i], name, length)) {
+
+      *value = (double)liveBytes[i];
+      return true;
+    }
+  }
+
+  return false;
+}
+
+int garbageCollectorStats(char* buffer, size_t size) {
+
+  GarbageCollectorStats* stats = &virtualmachine.gcStats;
+
+  int length = snprintf(buffer, size,
+      "{\"minorCollections\":%llu,\"majorCollections\":%llu,"
+      "\"compactions\":%llu,\"pauses\":%llu,"
+      "\"pauseTotalMicroseconds\":%.0f,\"pauseMaxMicroseconds\":%.0f,"
+      "\"pauseHistogram\":{",
+      (unsigned long long)stats->minorCollections,
+      (unsigned long long)stats->majorCollections,
+      (unsigned long long)stats->compactions,
+      (unsigned long long)stats->pauses,
+      stats->pauseTotal, stats->pauseMax);
+
+  double bound = 10;
+  for (int i = 0; i < GARBAGE_COLLECTOR_PAUSE_BUCKETS; i++, bound *= 10) {
+
+    if (length >= (int)size) return (int)size - 1;
+    if (i < GARBAGE_COLLECTOR_PAUSE_BUCKETS - 1) {
+
+      length += snprintf(buffer + length, size - length, "\"<%.0f\":%llu,",
+                         bound, (unsigned long long)stats->pauseHistogram[i]);
+    }
+    else {
+
+      length += snprintf(buffer + length, size - length, "\">=%.0f\":%llu}",
+                         bound / 10,
+                         (unsigned long long)stats->pauseHistogram[i]);
+    }
+  }
+
+  if (length >= (int)size) return (int)size - 1;
+  length += snprintf(buffer + length, size - length,
+      ",\"bytesAllocated\":%zu,\"peakBytes\":%zu,\"bytesFreed\":%zu,"
+      "\"liveBytes\":{",
+      virtualmachine.bytesAllocated, stats->peakBytes, stats->bytesFreed);
+
+  for (size_t i = 0; i < OBJECT_TYPE_COUNT; i++) {
+
+    if (length >= (int)size) return (int)size - 1;
+    length += snprintf(buffer + length, size - length, "%s\"%s\":%zu",
+                       i == 0 ? "" : ",", objectTypeNames[i], liveBytes[i]);
+  }
+
+  if (length >= (int)size) return (int)size - 1;
+  length += snprintf(buffer + length, size - length, "}}");
+  return length < (int)size ? length : (int)size - 1;
 }
 
 void freeObjects() {
-  
-  Object* object = virtualmachine.objects;
-  while (object != NULL) {
 
-    Object* next = object->next;
-    objectFree(object);
-    object = next;
+  sweepStep(INT_MAX);
+  allocatorClearMarks();
+  allocatorSweepBegin();
+  sweepStep(INT_MAX);
+
+#ifdef PARALLEL_MARKING
+  for (int i = 0; i < markersInitialized; i++) {
+
+    pthread_mutex_destroy(&markers[i].lock);
+    free(markers[i].objects);
   }
+  markersInitialized = 0;
+#endif
 
+#ifdef BACKGROUND_SWEEPING
+  if (sweeperInitialized) pthread_mutex_destroy(&sweeperLock);
+  sweeperInitialized = false;
+#endif
+
+  free(virtualmachine.youngObjects);
   free(virtualmachine.grayStack);
-}
\ No newline at end of file
+  free(virtualmachine.rememberedSet);
+  free(virtualmachine.slices);
+  freeAllocator();
+}
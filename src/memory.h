@@ -1,11 +1,14 @@
 #ifndef tango_memory_h
 #define tango_memory_h
 
+#include "allocator.h"
 #include "util.h"
 #include "object.h"
+#include "virtualmachine.h"
 
 #define ARRAY_SIZE_INCREASE_MULTIPLIER 2
 #define ARRAY_SIZE_DECREASE_MULTIPLIER 0.5 // ?
+#define GARBAGE_COLLECTOR_STATS_SIZE 1024
 
 #define ALLOCATE(type, count) \
   (type*)reallocate(NULL, 0, sizeof(type) * (count))
@@ -20,12 +23,61 @@
                     sizeof(type) * (newCount))
 
 #define FREE_ARRAY(type, pointer, oldCount) \
-  reallocate(pointer, sizeof(type) * oldCount, 0)
+  reallocate(pointer, sizeof(type) * (oldCount), 0)
 
 void* reallocate(void* pointer, size_t oldSize, size_t newSize);
+Object* allocateObject(size_t size);
 void objectMarkGarbage(Object* object);
 void valueMarkGarbage(Value value);
+void rememberObject(Object* object);
+void objectWriteBarrier(Object* owner);
+void collectYoungGarbage();
+void collectGarbageSlice();
 void collectGarbage();
+void compactGarbage();
+bool garbageCollectorStat(const char* name, int length, double* value);
+int garbageCollectorStats(char* buffer, size_t size);
 void freeObjects();
 
+static inline bool objectIsMarked(Object* object) {
+
+  return allocatorIsMarked(object);
+}
+
+static inline Object* objectForward(Object* object) {
+
+  if (object == NULL || !allocatorIsEvacuating(object)) return object;
+  return *(Object**)object;
+}
+
+static inline Value valueForward(Value value) {
+
+  if (!IS_OBJECT(value)) return value;
+  return OBJECT_VALUE(objectForward(AS_OBJECT(value)));
+}
+
+static inline void* arrayRelocate(void* pointer, size_t size) {
+
+  if (pointer == NULL || size == 0 || size > ALLOCATOR_MAX_SIZE) return pointer;
+  return allocatorRelocate(pointer);
+}
+
+static inline void writeBarrier(Object* owner, Value value) {
+
+  if (!IS_OBJECT(value)) return;
+
+  Object* object = AS_OBJECT(value);
+  if (objectHasFlag(owner, OBJECT_HEADER_OLD) &&
+      !objectHasFlag(owner, OBJECT_HEADER_REMEMBERED) &&
+      !objectHasFlag(object, OBJECT_HEADER_OLD)) {
+
+    rememberObject(owner);
+  }
+
+  if (virtualmachine.gcPhase == GARBAGE_COLLECTOR_MARK && objectIsMarked(owner)) {
+
+    objectMarkGarbage(object);
+  }
+}
+
 #endif
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "memory.h"
@@ -7,17 +8,18 @@
 #include "value.h"
 #include "virtualmachine.h"
 
+static uint32_t stringHash(const char* string, int size);
+
 #define ALLOCATE_OBJECT(type, objectType) \
   (type*)objectAllocate(sizeof(type), objectType)
 
+#define STRING_ROPE_MIN_SIZE 64
+#define STRING_SLICE_MIN_SIZE 16
+
 static Object* objectAllocate(size_t size, ObjectType type) {
  
-  Object* object = (Object*)reallocate(NULL, 0, size);
-  object->type = type;
-  object->isGarbage = false;
-
-  object->next = virtualmachine.objects;
-  virtualmachine.objects = object;
+  Object* object = allocateObject(size);
+  object->header = (uint32_t)type;
 
 #ifdef DEBUG_LOG_GARBAGE_COLLECTION
   printf("%p allocate %zu for %d\n", (void*)object, size, type);
@@ -38,9 +40,15 @@ ObjectBoundFunction* newBoundFunction(Value receiver,
 
 ObjectClass* newClass(ObjectString* name) {
 
+  ObjectShape* shape = newShape(NULL, NULL);
+  stackPush(OBJECT_VALUE(shape));
+
   ObjectClass* cclass = ALLOCATE_OBJECT(ObjectClass, OBJECT_CLASS);
   cclass->name = name;
+  cclass->shape = shape;
   initTable(&cclass->methods);
+
+  stackPop();
   return cclass;
 }
 
@@ -73,7 +81,10 @@ ObjectInstance* newInstance(ObjectClass* cclass) {
 
   ObjectInstance* instance = ALLOCATE_OBJECT(ObjectInstance, OBJECT_INSTANCE);
   instance->cclass = cclass;
-  initTable(&instance->fields);
+  instance->shape = cclass->shape;
+  instance->capacity = 0;
+  instance->fields = NULL;
+  instance->dictionary = NULL;
   return instance;
 }
 
@@ -85,6 +96,16 @@ ObjectNativeFunction* newNativeFunction(NativeFunction function) {
   return native;
 }
 
+ObjectShape* newShape(ObjectShape* parent, ObjectString* name) {
+
+  ObjectShape* shape = ALLOCATE_OBJECT(ObjectShape, OBJECT_SHAPE);
+  shape->parent = parent;
+  shape->name = name;
+  shape->count = parent == NULL ? 0 : parent->count + 1;
+  initTable(&shape->transitions);
+  return shape;
+}
+
 ObjectUpvalue* newUpvalue(Value* slot) {
 
   ObjectUpvalue* upvalue = ALLOCATE_OBJECT(ObjectUpvalue, OBJECT_UPVALUE);
@@ -94,55 +115,431 @@ ObjectUpvalue* newUpvalue(Value* slot) {
   return upvalue;
 }
 
-static ObjectString* stringAllocate(char* string, int size, uint32_t hash) {
-  
-  ObjectString* ostring = ALLOCATE_OBJECT(ObjectString, OBJECT_STRING);
+#ifdef WORD_STRING_HASH
+static void hashMultiply(uint64_t* a, uint64_t* b) {
+
+#ifdef __SIZEOF_INT128__
+  __uint128_t product = (__uint128_t)*a * *b;
+  *a = (uint64_t)product;
+  *b = (uint64_t)(product >> 64);
+#else
+  uint64_t aHigh = *a >> 32, aLow = (uint32_t)*a;
+  uint64_t bHigh = *b >> 32, bLow = (uint32_t)*b;
+  uint64_t high = aHigh * bHigh, middle0 = aHigh * bLow;
+  uint64_t middle1 = aLow * bHigh, low = aLow * bLow;
+  uint64_t carry = (uint64_t)(uint32_t)middle0 + (uint32_t)middle1 + (low >> 32);
+  *a = low + (middle0 << 32) + (middle1 << 32);
+  *b = high + (middle0 >> 32) + (middle1 >> 32) + (carry >> 32);
+#endif
+}
+
+static uint64_t hashMix(uint64_t a, uint64_t b) {
+
+  hashMultiply(&a, &b);
+  return a ^ b;
+}
+
+static uint64_t hashRead64(const char* string) {
+
+  uint64_t word;
+  memcpy(&word, string, sizeof(word));
+  return word;
+}
+
+static uint64_t hashRead32(const char* string) {
+
+  uint32_t word;
+  memcpy(&word, string, sizeof(word));
+  return word;
+}
+
+static uint32_t stringHashSeeded(const char* string, int size, uint64_t seed) {
+
+  static const uint64_t secret[4] = {
+
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+    0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+  };
+
+  size_t length = (size_t)size;
+  uint64_t a;
+  uint64_t b;
+
+  seed ^= hashMix(seed ^ secret[0], secret[1]);
+  if (length <= 16) {
+
+    if (length >= 4) {
+
+      size_t middle = (length >> 3) << 2;
+      a = (hashRead32(string) << 32) | hashRead32(string + middle);
+      b = (hashRead32(string + length - 4) << 32) |
+          hashRead32(string + length - 4 - middle);
+    }
+    else if (length > 0) {
+
+      a = ((uint64_t)(uint8_t)string[0] << 16) |
+          ((uint64_t)(uint8_t)string[length >> 1] << 8) |
+          (uint8_t)string[length - 1];
+      b = 0;
+    }
+    else {
+
+      a = 0;
+      b = 0;
+    }
+  }
+  else {
+
+    size_t remaining = length;
+    if (remaining > 48) {
+
+      uint64_t seed1 = seed;
+      uint64_t seed2 = seed;
+      do {
+
+        seed = hashMix(hashRead64(string) ^ secret[1],
+                       hashRead64(string + 8) ^ seed);
+        seed1 = hashMix(hashRead64(string + 16) ^ secret[2],
+                        hashRead64(string + 24) ^ seed1);
+        seed2 = hashMix(hashRead64(string + 32) ^ secret[3],
+                        hashRead64(string + 40) ^ seed2);
+        string += 48;
+        remaining -= 48;
+      } while (remaining > 48);
+
+      seed ^= seed1 ^ seed2;
+    }
+
+    while (remaining > 16) {
+
+      seed = hashMix(hashRead64(string) ^ secret[1],
+                     hashRead64(string + 8) ^ seed);
+      string += 16;
+      remaining -= 16;
+    }
+
+    a = hashRead64(string + remaining - 16);
+    b = hashRead64(string + remaining - 8);
+  }
+
+  a ^= secret[1];
+  b ^= seed;
+  hashMultiply(&a, &b);
+  return (uint32_t)hashMix(a ^ secret[0] ^ length, b ^ secret[1]);
+}
+#else
+static uint32_t stringHashSeeded(const char* string, int size, uint64_t seed) {
+
+  uint32_t hash = 2166136261u ^ (uint32_t)seed;
+  for (int i = 0; i < size; i++) {
+
+    hash ^= (uint8_t)string[i];
+    hash *= 16777619;
+  }
+
+  return hash;
+}
+#endif
+
+static uint32_t stringHash(const char* string, int size) {
+
+  return stringHashSeeded(string, size, virtualmachine.hashSeed);
+}
+
+ObjectString* newString(const char* string, int size) {
+
+  ObjectString* ostring;
+  if (size < STRING_INLINE_MAX_SIZE) {
+
+    ostring = (ObjectString*)objectAllocate(sizeof(ObjectString) + size + 1,
+                                            OBJECT_STRING);
+    ostring->string = (char*)(ostring + 1);
+  }
+  else {
+
+    char* heapString = ALLOCATE(char, size + 1);
+    ostring = ALLOCATE_OBJECT(ObjectString, OBJECT_STRING);
+    ostring->string = heapString;
+  }
+
   ostring->size = size;
-  ostring->string = string;
+  ostring->hash = 0;
+  memcpy(ostring->string, string, size);
+  ostring->string[size] = '\0';
+  return ostring;
+}
+
+ObjectString* stringCopy(const char* string, int size) {
+
+  uint32_t hash = stringHash(string, size);
+  ObjectString* interned = tableGetString(&virtualmachine.strings, string, size, hash);
+  if (interned != NULL) return interned;
+
+  ObjectString* ostring = newString(string, size);
   ostring->hash = hash;
+  objectSetFlag((Object*)ostring, OBJECT_HEADER_HASHED | OBJECT_HEADER_INTERNED);
 
-  stackPush(OBJECT_VALUE(string));
+  stackPush(OBJECT_VALUE(ostring));
   tableSetValue(&virtualmachine.strings, ostring, NIL_VAL);
   stackPop();
-  
+
   return ostring;
 }
 
-ObjectString* stringTake(char* string, int size) {
+ObjectString* stringConcatenate(ObjectString* a, ObjectString* b) {
 
-  uint32_t hash = stringHash(string, size);
-  ObjectString* interned = tableGetString(&virtualmachine.strings, string, size, hash);
-  if (interned != NULL) {
+  if (a->size == 0) return b;
+  if (b->size == 0) return a;
 
-    FREE_ARRAY(char, string, size + 1);
-    return interned;
+  int size = a->size + b->size;
+  if (size < STRING_ROPE_MIN_SIZE) {
+
+    char chars[STRING_ROPE_MIN_SIZE];
+    memcpy(chars, a->string, a->size);
+    memcpy(chars + a->size, b->string, b->size);
+    return newString(chars, size);
   }
 
-  return stringAllocate(string, size, hash);
+  ObjectRope* rope = ALLOCATE_OBJECT(ObjectRope, OBJECT_STRING);
+  objectSetFlag((Object*)rope, OBJECT_HEADER_ROPE);
+  rope->string.size = size;
+  rope->string.string = NULL;
+  rope->string.hash = 0;
+  rope->left = a;
+  rope->right = b;
+  return (ObjectString*)rope;
 }
 
-ObjectString* stringCopy(const char* string, int size) {
+static void ropeFlatten(ObjectRope* rope) {
 
-  uint32_t hash = stringHash(string, size);
-  ObjectString* interned = tableGetString(&virtualmachine.strings, string, size, hash);
-  if (interned != NULL) return interned;
+  ObjectString* string = &rope->string;
+  stackPush(OBJECT_VALUE(string));
+  char* chars = ALLOCATE(char, string->size + 1);
+  stackPop();
+
+  chars[string->size] = '\0';
+  char* end = chars + string->size;
+
+  ObjectString** pending = NULL;
+  int pendingCount = 0;
+  int pendingCapacity = 0;
+
+  ObjectString* node = string;
+  for (;;) {
+
+    if (node->string == NULL) {
+
+      if (pendingCapacity < pendingCount + 1) {
+
+        pendingCapacity = INCREASE_SIZE(pendingCapacity);
+        pending = (ObjectString**)realloc(pending,
+                                          sizeof(ObjectString*) * pendingCapacity);
+
+        if (pending == NULL) exit(1);
+      }
+
+      pending[pendingCount++] = ((ObjectRope*)node)->left;
+      node = ((ObjectRope*)node)->right;
+      continue;
+    }
 
-  char* heapString = ALLOCATE(char, size + 1);
-  memcpy(heapString, string, size);
-  heapString[size] = '\0';
-  return stringAllocate(heapString, size, hash);
+    end -= node->size;
+    memcpy(end, node->string, node->size);
+    if (pendingCount == 0) break;
+    node = pending[--pendingCount];
+  }
+
+  free(pending);
+
+  string->string = chars;
+  rope->left = NULL;
+  rope->right = NULL;
 }
 
-static uint32_t stringHash(const char* string, int size) {
+char* stringChars(ObjectString* string) {
 
-  uint32_t hash = 2166136261u;
-  for (int i = 0; i < size; i++) {
+  if (string->string == NULL) ropeFlatten((ObjectRope*)string);
+  return string->string;
+}
 
-    hash ^= (uint8_t)string[i];
-    hash *= 16777619;
+uint32_t stringGetHash(ObjectString* string) {
+
+  if (!objectHasFlag((Object*)string, OBJECT_HEADER_HASHED)) {
+
+    string->hash = stringHash(stringChars(string), string->size);
+    objectSetFlag((Object*)string, OBJECT_HEADER_HASHED);
   }
 
-  return hash;
+  return string->hash;
+}
+
+bool stringsEqual(ObjectString* a, ObjectString* b) {
+
+  if (a == b) return true;
+  if (a->size != b->size) return false;
+  if (objectHasFlag((Object*)a, OBJECT_HEADER_INTERNED) &&
+      objectHasFlag((Object*)b, OBJECT_HEADER_INTERNED)) return false;
+
+  stackPush(OBJECT_VALUE(a));
+  stackPush(OBJECT_VALUE(b));
+  bool isEqual = stringGetHash(a) == stringGetHash(b);
+  stackPop();
+  stackPop();
+
+  return isEqual && memcmp(a->string, b->string, a->size) == 0;
+}
+
+ObjectString* stringSlice(ObjectString* string, int start, int size) {
+
+  if (start < 0) start = 0;
+  if (start > string->size) start = string->size;
+  if (size < 0) size = 0;
+  if (size > string->size - start) size = string->size - start;
+
+  if (start == 0 && size == string->size) return string;
+
+  char* chars = stringChars(string);
+  if (size < STRING_SLICE_MIN_SIZE) return newString(chars + start, size);
+
+  ObjectString* parent = string;
+  if (objectHasFlag((Object*)string, OBJECT_HEADER_SLICE) &&
+      ((ObjectSlice*)string)->parent != NULL) {
+
+    parent = ((ObjectSlice*)string)->parent;
+    start += ((ObjectSlice*)string)->offset;
+  }
+
+  stackPush(OBJECT_VALUE(parent));
+  ObjectSlice* slice = ALLOCATE_OBJECT(ObjectSlice, OBJECT_STRING);
+  objectSetFlag((Object*)slice, OBJECT_HEADER_SLICE);
+  slice->string.size = size;
+  slice->string.string = parent->string + start;
+  slice->string.hash = 0;
+  slice->parent = parent;
+  slice->offset = start;
+
+  if (virtualmachine.sliceCapacity < virtualmachine.sliceCount + 1) {
+
+    virtualmachine.sliceCapacity = INCREASE_SIZE(virtualmachine.sliceCapacity);
+    virtualmachine.slices = (Object**)realloc(
+        virtualmachine.slices, sizeof(Object*) * virtualmachine.sliceCapacity);
+
+    if (virtualmachine.slices == NULL) exit(1);
+  }
+
+  virtualmachine.slices[virtualmachine.sliceCount++] = (Object*)slice;
+  stackPop();
+  return (ObjectString*)slice;
+}
+
+int stringIndexOf(ObjectString* string, ObjectString* pattern, int from) {
+
+  stackPush(OBJECT_VALUE(string));
+  char* chars = stringChars(string);
+  char* patternChars = stringChars(pattern);
+  stackPop();
+
+  if (pattern->size == 0) return from <= string->size ? from : -1;
+
+  int last = string->size - pattern->size;
+  for (int i = from; i <= last; i++) {
+
+    char* found = memchr(chars + i, patternChars[0], last - i + 1);
+    if (found == NULL) break;
+
+    i = (int)(found - chars);
+    if (memcmp(found, patternChars, pattern->size) == 0) return i;
+  }
+
+  return -1;
+}
+
+int shapeGetIndex(ObjectShape* shape, ObjectString* name) {
+
+  for (; shape->parent != NULL; shape = shape->parent) {
+
+    if (shape->name == name) return shape->count - 1;
+  }
+
+  return -1;
+}
+
+ObjectShape* shapeTransition(ObjectShape* shape, ObjectString* name) {
+
+  Value transition;
+  if (tableGetValue(&shape->transitions, name, &transition)) {
+
+    return AS_SHAPE(transition);
+  }
+
+  ObjectShape* child = newShape(shape, name);
+  stackPush(OBJECT_VALUE(child));
+  tableSetValue(&shape->transitions, name, OBJECT_VALUE(child));
+  writeBarrier((Object*)shape, OBJECT_VALUE(child));
+  stackPop();
+  return child;
+}
+
+static void instanceToDictionary(ObjectInstance* instance) {
+
+  instance->dictionary = ALLOCATE(Table, 1);
+  initTable(instance->dictionary);
+
+  for (ObjectShape* shape = instance->shape;
+       shape->parent != NULL;
+       shape = shape->parent) {
+
+    tableSetValue(instance->dictionary, shape->name,
+                  instance->fields[shape->count - 1]);
+    writeBarrier((Object*)instance, instance->fields[shape->count - 1]);
+  }
+
+  FREE_ARRAY(Value, instance->fields, instance->capacity);
+  instance->shape = NULL;
+  instance->capacity = 0;
+  instance->fields = NULL;
+}
+
+void instanceSetField(ObjectInstance* instance, ObjectString* name,
+                      Value value) {
+
+  if (instance->shape != NULL) {
+
+    int index = shapeGetIndex(instance->shape, name);
+    if (index != -1) {
+
+      instance->fields[index] = value;
+      writeBarrier((Object*)instance, value);
+      return;
+    }
+
+    if (instance->shape->count == SHAPE_MAX_FIELDS) {
+
+      instanceToDictionary(instance);
+    }
+  }
+
+  if (instance->shape == NULL) {
+
+    tableSetValue(instance->dictionary, name, value);
+    writeBarrier((Object*)instance, OBJECT_VALUE(name));
+    writeBarrier((Object*)instance, value);
+    return;
+  }
+
+  ObjectShape* shape = shapeTransition(instance->shape, name);
+  if (shape->count > instance->capacity) {
+
+    int capacity = instance->capacity < 4 ? 4 : instance->capacity * 2;
+    instance->fields = GROW_ARRAY(Value, instance->fields,
+                                  instance->capacity, capacity);
+    instance->capacity = capacity;
+  }
+
+  instance->fields[shape->count - 1] = value;
+  instance->shape = shape;
+  writeBarrier((Object*)instance, value);
+  writeBarrier((Object*)instance, OBJECT_VALUE(shape));
 }
 
 static void functionPrint(ObjectFunction* function) {
@@ -191,9 +588,14 @@ void objectPrint(Value value) {
       printf("<native fn>");
       break;
       
+    case OBJECT_SHAPE:
+
+      printf("shape");
+      break;
+
     case OBJECT_STRING:
 
-      printf("%s", AS_CSTRING(value));
+      printf("%.*s", AS_STRING(value)->size, AS_CSTRING(value));
       break;
 
     case OBJECT_UPVALUE:
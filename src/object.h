@@ -6,7 +6,7 @@
 #include "table.h"
 #include "value.h"
 
-#define OBJECT_TYPE(value) (AS_OBJECT(value)->type)
+#define OBJECT_TYPE(value) objectType(AS_OBJECT(value))
 
 #define IS_BOUND_FUNCTION(value) objectIsType(value, OBJECT_BOUND_FUNCTION)
 #define IS_CLASS(value) objectIsType(value, OBJECT_CLASS)
@@ -14,6 +14,7 @@
 #define IS_FUNCTION(value) objectIsType(value, OBJECT_FUNCTION)
 #define IS_INSTANCE(value) objectIsType(value, OBJECT_INSTANCE)
 #define IS_NATIVE_FUNCTION(value) objectIsType(value, OBJECT_NATIVE_FUNCTION)
+#define IS_SHAPE(value) objectIsType(value, OBJECT_SHAPE)
 #define IS_STRING(value) objectIsType(value, OBJECT_STRING)
 
 #define AS_BOUND_FUNCTION(value) ((ObjectBoundFunction*)AS_OBJECT(value))
@@ -23,8 +24,21 @@
 #define AS_INSTANCE(value) ((ObjectInstance*)AS_OBJECT(value))
 #define AS_NATIVE_FUNCTION(value) \
     (((ObjectNativeFunction*)AS_OBJECT(value))->function)
+#define AS_SHAPE(value) ((ObjectShape*)AS_OBJECT(value))
 #define AS_STRING(value) ((ObjectString*)AS_OBJECT(value))
-#define AS_CSTRING(value) (((ObjectString*)AS_OBJECT(value))->string)
+#define AS_CSTRING(value) stringChars(AS_STRING(value))
+
+#define SHAPE_MAX_FIELDS 32
+
+#define OBJECT_HEADER_TYPE 0xff
+#define OBJECT_HEADER_OLD (1u << 8)
+#define OBJECT_HEADER_REMEMBERED (1u << 9)
+#define OBJECT_HEADER_ROPE (1u << 10)
+#define OBJECT_HEADER_INTERNED (1u << 11)
+#define OBJECT_HEADER_HASHED (1u << 12)
+#define OBJECT_HEADER_SLICE (1u << 13)
+
+#define STRING_INLINE_MAX_SIZE 192
 
 typedef enum {
   OBJECT_FUNCTION,  
@@ -33,14 +47,13 @@ typedef enum {
   OBJECT_CLASS,
   OBJECT_CLOSURE,
   OBJECT_INSTANCE,
+  OBJECT_SHAPE,
   OBJECT_STRING,
   OBJECT_UPVALUE,
 } ObjectType;
 
 struct Object {
-  ObjectType type;
-  bool isGarbage;
-  struct Object* next;
+  uint32_t header;
 };
 
 typedef struct {
@@ -65,6 +78,18 @@ struct ObjectString {
   uint32_t hash;
 };
 
+typedef struct {
+  ObjectString string;
+  ObjectString* left;
+  ObjectString* right;
+} ObjectRope;
+
+typedef struct {
+  ObjectString string;
+  ObjectString* parent;
+  int offset;
+} ObjectSlice;
+
 typedef struct ObjectUpvalue {
   Object object;
   Value* location;
@@ -74,21 +99,33 @@ typedef struct ObjectUpvalue {
 
 typedef struct {
   Object object;
+  int upvalueCount;
   ObjectFunction* function;
   ObjectUpvalue** upvalues;
-  int upvalueCount;
 } ObjectClosure;
 
+typedef struct ObjectShape {
+  Object object;
+  int count;
+  struct ObjectShape* parent;
+  ObjectString* name;
+  Table transitions;
+} ObjectShape;
+
 typedef struct {
   Object object;
   ObjectString* name;
+  ObjectShape* shape;
   Table methods;
 } ObjectClass;
 
 typedef struct {
   Object object;
+  int capacity;
   ObjectClass* cclass;
-  Table fields;
+  ObjectShape* shape;
+  Value* fields;
+  Table* dictionary;
 } ObjectInstance;
 
 typedef struct {
@@ -104,14 +141,48 @@ ObjectClosure* newClosure(ObjectFunction* function);
 ObjectFunction* newFunction();
 ObjectInstance* newInstance(ObjectClass* cclass);
 ObjectNativeFunction* newNativeFunction(NativeFunction function);
+ObjectShape* newShape(ObjectShape* parent, ObjectString* name);
 ObjectUpvalue* newUpvalue(Value* slot);
-ObjectString* stringTake(char* string, int size);
+ObjectString* newString(const char* string, int size);
 ObjectString* stringCopy(const char* string, int size);
+ObjectString* stringConcatenate(ObjectString* a, ObjectString* b);
+char* stringChars(ObjectString* string);
+uint32_t stringGetHash(ObjectString* string);
+ObjectString* stringSlice(ObjectString* string, int start, int size);
+int stringIndexOf(ObjectString* string, ObjectString* pattern, int from);
+bool stringsEqual(ObjectString* a, ObjectString* b);
+
+int shapeGetIndex(ObjectShape* shape, ObjectString* name);
+ObjectShape* shapeTransition(ObjectShape* shape, ObjectString* name);
+void instanceSetField(ObjectInstance* instance, ObjectString* name,
+                      Value value);
 
 void objectPrint(Value value);
 
+static inline ObjectType objectType(Object* object) {
+  return (ObjectType)(object->header & OBJECT_HEADER_TYPE);
+}
+
+static inline bool objectHasFlag(Object* object, uint32_t flag) {
+  return (object->header & flag) != 0;
+}
+
+static inline void objectSetFlag(Object* object, uint32_t flag) {
+  object->header |= flag;
+}
+
+static inline void objectClearFlag(Object* object, uint32_t flag) {
+  object->header &= ~flag;
+}
+
+static inline bool stringIsInline(ObjectString* string) {
+  return !objectHasFlag((Object*)string,
+                        OBJECT_HEADER_ROPE | OBJECT_HEADER_SLICE) &&
+         string->size < STRING_INLINE_MAX_SIZE;
+}
+
 static inline bool objectIsType(Value value, ObjectType type) {
-  return IS_OBJECT(value) && AS_OBJECT(value)->type == type;
+  return IS_OBJECT(value) && objectType(AS_OBJECT(value)) == type;
 }
 
 #endif
\ No newline at end of file
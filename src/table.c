@@ -165,9 +165,20 @@ void tableRemoveGarbage(Table* table) {
   for (int i = 0; i < table->size; i++) {
 
     Pair* pair = &table->pairs[i];
-    if (pair->key != NULL && !pair->key->object.isGarbage) {
+    if (pair->key != NULL && !objectIsMarked((Object*)pair->key)) {
 
       tableRemoveValue(table, pair->key);
     }
   }
-}
\ No newline at end of file
+}
+
+void tableRelocate(Table* table) {
+
+  table->pairs = arrayRelocate(table->pairs, sizeof(Pair) * table->size);
+  for (int i = 0; i < table->size; i++) {
+
+    Pair* pair = &table->pairs[i];
+    pair->key = (ObjectString*)objectForward((Object*)pair->key);
+    pair->value = valueForward(pair->value);
+  }
+}
@@ -25,5 +25,6 @@ ObjectString* tableGetString(Table* table, const char* string,
                              int size, uint32_t hash);
 void tableRemoveGarbage(Table* table);
 void tableCollectGarbage(Table* table);
+void tableRelocate(Table* table);
 
 #endif
\ No newline at end of file
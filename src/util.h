@@ -11,10 +11,30 @@
 #define DEBUG_STRESS_GARBAGE_COLLECTION
 #define DEBUG_LOG_GARBAGE_COLLECTION
 #define UINT8_COUNT (UINT8_MAX + 1)
+#define UINT24_MAX 0xffffff
+
+#define THREADED_DISPATCH
+#define PARALLEL_MARKING
+#define BACKGROUND_SWEEPING
+#define WORD_STRING_HASH
 
 
 #undef DEBUG_STRESS_GARBAGE_COLLECTION
 #undef DEBUG_LOG_GARBAGE_COLLECTION
 #undef DEBUG_PRINT_CODE
+#undef DEBUG_TRACE_EXECUTION
+
+#if !defined(__GNUC__) || defined(SWITCH_DISPATCH)
+  #undef THREADED_DISPATCH
+#endif
+
+#if !defined(__GNUC__) || defined(_WIN32)
+  #undef PARALLEL_MARKING
+  #undef BACKGROUND_SWEEPING
+#endif
+
+#ifdef FNV_STRING_HASH
+  #undef WORD_STRING_HASH
+#endif
 
 #endif
\ No newline at end of file
@@ -58,5 +58,11 @@ bool valuesEqual(Value a, Value b) {
     
     return AS_NUMBER(a) == AS_NUMBER(b);
   }
+
+  if (a != b && IS_STRING(a) && IS_STRING(b)) {
+
+    return stringsEqual(AS_STRING(a), AS_STRING(b));
+  }
+
   return a == b;
 }
\ No newline at end of file
@@ -13,6 +13,7 @@ typedef struct ObjectString ObjectString;
 #define TAG_NIL 1
 #define TAG_FALSE 2
 #define TAG_TRUE 3
+#define TAG_UNDEFINED 4
 
 typedef uint64_t Value;
 
@@ -24,6 +25,7 @@ typedef struct {
 
 #define IS_BOOL(value) (((value) | 1) == TRUE_VALUE)
 #define IS_NIL(value) ((value) == NIL_VAL)
+#define IS_UNDEFINED(value) ((value) == UNDEFINED_VALUE)
 #define IS_NUMBER(value) (((value) & QNAN) != QNAN)
 #define IS_OBJECT(value) \
   (((value) & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT))
@@ -37,6 +39,7 @@ typedef struct {
 #define FALSE_VALUE ((Value)(uint64_t)(QNAN | TAG_FALSE))
 #define TRUE_VALUE ((Value)(uint64_t)(QNAN | TAG_TRUE))
 #define NIL_VAL ((Value)(uint64_t)(QNAN | TAG_NIL))
+#define UNDEFINED_VALUE ((Value)(uint64_t)(QNAN | TAG_UNDEFINED))
 #define NUMBER_VALUE(num) numToValue(num)
 #define OBJECT_VALUE(object) \
   (Value)(SIGN_BIT | QNAN | (uint64_t)(uintptr_t)(object))
@@ -1,5 +1,7 @@
+#include <setjmp.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <time.h>
@@ -16,8 +18,131 @@ static Value clockNative(int argCount, Value* args) {
   return NUMBER_VALUE((double)clock() / CLOCKS_PER_SEC);
 }
 
+static Value gcStatsNative(int argCount, Value* args) {
+
+  if (argCount == 1 && IS_STRING(args[0])) {
+
+    double value;
+    ObjectString* name = AS_STRING(args[0]);
+    if (!garbageCollectorStat(stringChars(name), name->size, &value)) {
+
+      return NIL_VAL;
+    }
+
+    return NUMBER_VALUE(value);
+  }
+
+  char buffer[GARBAGE_COLLECTOR_STATS_SIZE];
+  int length = garbageCollectorStats(buffer, sizeof(buffer));
+  return OBJECT_VALUE(newString(buffer, length));
+}
+
+// Returns -1 for a NaN index so the natives can answer nil rather than
+// guess at a position.
+static int indexClamp(double index, int size) {
+
+  if (isnan(index)) return -1;
+  if (index < 0) index += size;
+  if (index < 0) return 0;
+  if (index > size) return size;
+  return (int)index;
+}
+
+static Value substringNative(int argCount, Value* args) {
+
+  if (argCount < 2 || !IS_STRING(args[0]) || !IS_NUMBER(args[1])) {
+
+    return NIL_VAL;
+  }
+
+  ObjectString* string = AS_STRING(args[0]);
+  int start = indexClamp(AS_NUMBER(args[1]), string->size);
+  if (start < 0) return NIL_VAL;
+
+  int size = string->size - start;
+  if (argCount > 2 && IS_NUMBER(args[2])) {
+
+    double length = AS_NUMBER(args[2]);
+    if (isnan(length)) return NIL_VAL;
+    if (length < size) size = length > 0 ? (int)length : 0;
+  }
+
+  return OBJECT_VALUE(stringSlice(string, start, size));
+}
+
+static Value sliceNative(int argCount, Value* args) {
+
+  if (argCount < 2 || !IS_STRING(args[0]) || !IS_NUMBER(args[1])) {
+
+    return NIL_VAL;
+  }
+
+  ObjectString* string = AS_STRING(args[0]);
+  int start = indexClamp(AS_NUMBER(args[1]), string->size);
+  int end = string->size;
+  if (argCount > 2 && IS_NUMBER(args[2])) {
+
+    end = indexClamp(AS_NUMBER(args[2]), string->size);
+  }
+
+  if (start < 0 || end < 0) return NIL_VAL;
+  if (end < start) end = start;
+  return OBJECT_VALUE(stringSlice(string, start, end - start));
+}
+
+static Value indexOfNative(int argCount, Value* args) {
+
+  if (argCount < 2 || !IS_STRING(args[0]) || !IS_STRING(args[1])) {
+
+    return NIL_VAL;
+  }
+
+  ObjectString* string = AS_STRING(args[0]);
+  int from = 0;
+  if (argCount > 2 && IS_NUMBER(args[2])) {
+
+    from = indexClamp(AS_NUMBER(args[2]), string->size);
+    if (from < 0) return NIL_VAL;
+  }
+
+  return NUMBER_VALUE(stringIndexOf(string, AS_STRING(args[1]), from));
+}
+
+static Value splitNative(int argCount, Value* args) {
+
+  if (argCount < 3 || !IS_STRING(args[0]) || !IS_STRING(args[1]) ||
+      !IS_NUMBER(args[2])) {
+
+    return NIL_VAL;
+  }
+
+  ObjectString* string = AS_STRING(args[0]);
+  ObjectString* separator = AS_STRING(args[1]);
+  if (separator->size == 0) return NIL_VAL;
+
+  // Every field before the one requested needs at least one separator
+  // character, so an index past the string's size (or NaN) can't match.
+  double index = AS_NUMBER(args[2]);
+  if (!(index >= 0 && index <= string->size)) return NIL_VAL;
+
+  int start = 0;
+  for (int field = (int)index; field > 0; field--) {
+
+    int found = stringIndexOf(string, separator, start);
+    if (found < 0) return NIL_VAL;
+    start = found + separator->size;
+  }
+
+  int end = stringIndexOf(string, separator, start);
+  if (end < 0) end = string->size;
+  return OBJECT_VALUE(stringSlice(string, start, end - start));
+}
+
 VirtualMachine virtualmachine;
 
+static jmp_buf errorHandler;
+static bool hasErrorHandler = false;
+
 static void cleanStack() {
 
   virtualmachine.stackTop = virtualmachine.stack;
@@ -66,11 +191,30 @@ Value stackPop() {
   return *virtualmachine.stackTop;
 }
 
+int globalSlot(ObjectString* name) {
+
+  Value slot;
+  if (tableGetValue(&virtualmachine.globalSlots, name, &slot)) {
+
+    return (int)AS_NUMBER(slot);
+  }
+
+  stackPush(OBJECT_VALUE(name));
+  writeValueArray(&virtualmachine.globalNames, OBJECT_VALUE(name));
+  writeValueArray(&virtualmachine.globalValues, UNDEFINED_VALUE);
+  tableSetValue(&virtualmachine.globalSlots, name,
+                NUMBER_VALUE(virtualmachine.globalValues.count - 1));
+  stackPop();
+
+  return virtualmachine.globalValues.count - 1;
+}
+
 static void defineNativeFunction(const char* name, NativeFunction function) {
 
   stackPush(OBJECT_VALUE(stringCopy(name, (int)strlen(name))));
   stackPush(OBJECT_VALUE(newNativeFunction(function)));
-  tableSetValue(&virtualmachine.globals, AS_STRING(virtualmachine.stack[0]), virtualmachine.stack[1]);
+  int slot = globalSlot(AS_STRING(virtualmachine.stack[0]));
+  virtualmachine.globalValues.values[slot] = virtualmachine.stack[1];
 
   stackPop();
   stackPop();
@@ -79,26 +223,61 @@ static void defineNativeFunction(const char* name, NativeFunction function) {
 void initVirtualMachine() {
 
   cleanStack();
-  virtualmachine.objects = NULL;
   virtualmachine.bytesAllocated = 0;
+  virtualmachine.youngBytes = 0;
   virtualmachine.nextGC = 1024 * 1024;
+  virtualmachine.gcPhase = GARBAGE_COLLECTOR_IDLE;
+  virtualmachine.gcSliceBudget = 0;
+  virtualmachine.gcMarkers = 1;
+  virtualmachine.gcTargetShare = 0;
+  virtualmachine.gcPauseTarget = 0;
+  virtualmachine.gcMultiplier = GARBAGE_COLLECTOR_HEAP_SIZE_MULTIPLIER;
+  virtualmachine.heapLimit = 0;
+  virtualmachine.gcTime = 0;
+  virtualmachine.gcCycleStart = clock();
+  memset(&virtualmachine.gcStats, 0, sizeof(virtualmachine.gcStats));
+  virtualmachine.gcCompactThreshold = 0;
+  virtualmachine.compactRequested = false;
+
+  virtualmachine.youngCount = 0;
+  virtualmachine.youngCapacity = 0;
+  virtualmachine.youngObjects = NULL;
 
   virtualmachine.grayCount = 0;
   virtualmachine.grayCapacity = 0;
   virtualmachine.grayStack = NULL;
 
-  initTable(&virtualmachine.globals);
+  virtualmachine.rememberedCount = 0;
+  virtualmachine.rememberedCapacity = 0;
+  virtualmachine.rememberedSet = NULL;
+
+  virtualmachine.sliceCount = 0;
+  virtualmachine.sliceCapacity = 0;
+  virtualmachine.slices = NULL;
+
+  initTable(&virtualmachine.globalSlots);
+  initValueArray(&virtualmachine.globalNames);
+  initValueArray(&virtualmachine.globalValues);
   initTable(&virtualmachine.strings);
+  virtualmachine.hashSeed = (uint64_t)time(NULL) ^
+                           (uint64_t)(uintptr_t)&virtualmachine;
 
   virtualmachine.initString = NULL;
   virtualmachine.initString = stringCopy("init", 4);
 
   defineNativeFunction("clock", clockNative);
+  defineNativeFunction("gcStats", gcStatsNative);
+  defineNativeFunction("substring", substringNative);
+  defineNativeFunction("slice", sliceNative);
+  defineNativeFunction("indexOf", indexOfNative);
+  defineNativeFunction("split", splitNative);
 }
 
 void freeVirtualMachine() {
 
-  freeTable(&virtualmachine.globals);
+  freeTable(&virtualmachine.globalSlots);
+  freeValueArray(&virtualmachine.globalNames);
+  freeValueArray(&virtualmachine.globalValues);
   freeTable(&virtualmachine.strings);
   virtualmachine.initString = NULL;
   freeObjects();
@@ -185,6 +364,69 @@ static bool callValue(Value callee, int argCount) {
   return false;
 }
 
+static InlineCacheEntry* cacheLookup(InlineCache* cache, ObjectShape* shape) {
+
+  if (shape == NULL) return NULL;
+
+  for (int i = 0; i < INLINE_CACHE_ENTRIES; i++) {
+
+    InlineCacheEntry* entry = &cache->entries[i];
+    if (entry->shape == (Object*)shape) return entry;
+  }
+
+  return NULL;
+}
+
+static void cacheUpdate(InlineCache* cache, ObjectShape* shape,
+                        ObjectShape* transition, int index, Value method) {
+
+  if (shape == NULL) return;
+
+  CallFrame* frame = &virtualmachine.frames[virtualmachine.frameCount - 1];
+  objectWriteBarrier((Object*)frame->closure->function);
+
+  InlineCacheEntry* entry = cacheLookup(cache, shape);
+  if (entry == NULL) {
+
+    entry = &cache->entries[cache->next];
+    cache->next = (cache->next + 1) % INLINE_CACHE_ENTRIES;
+  }
+
+  entry->shape = (Object*)shape;
+  entry->transition = (Object*)transition;
+  entry->index = index;
+  entry->method = method;
+}
+
+static bool findField(ObjectInstance* instance, ObjectString* name,
+                      InlineCache* cache, Value* value) {
+
+  if (instance->shape == NULL) {
+
+    return tableGetValue(instance->dictionary, name, value);
+  }
+
+  int index = shapeGetIndex(instance->shape, name);
+  if (index == -1) return false;
+
+  cacheUpdate(cache, instance->shape, NULL, index, NIL_VAL);
+  *value = instance->fields[index];
+  return true;
+}
+
+static bool findMethod(ObjectInstance* instance, ObjectString* name,
+                       InlineCache* cache, Value* method) {
+
+  if (!tableGetValue(&instance->cclass->methods, name, method)) {
+
+    runtimeError("Undefined property '%s'.", name->string);
+    return false;
+  }
+
+  cacheUpdate(cache, instance->shape, NULL, -1, *method);
+  return true;
+}
+
 static bool invokeFromClass(ObjectClass* cclass, ObjectString* name, int argCount) {
 
   Value method;
@@ -197,7 +439,7 @@ static bool invokeFromClass(ObjectClass* cclass, ObjectString* name, int argCoun
   return call(AS_CLOSURE(method), argCount);
 }
 
-static bool invoke(ObjectString* name, int argCount) {
+static bool invoke(ObjectString* name, int argCount, InlineCache* cache) {
 
   Value receiver = peek(argCount);
   if (!IS_INSTANCE(receiver)) {
@@ -207,14 +449,34 @@ static bool invoke(ObjectString* name, int argCount) {
   }
 
   ObjectInstance* instance = AS_INSTANCE(receiver);
+  InlineCacheEntry* entry = cacheLookup(cache, instance->shape);
   Value value;
-  if (tableGetValue(&instance->fields, name, &value)) {
+  if (entry != NULL) {
+
+    if (entry->index == -1) return call(AS_CLOSURE(entry->method), argCount);
 
+    value = instance->fields[entry->index];
     virtualmachine.stackTop[-argCount - 1] = value;
     return callValue(value, argCount);
   }
 
-  return invokeFromClass(instance->cclass, name, argCount);
+  if (findField(instance, name, cache, &value)) {
+
+    virtualmachine.stackTop[-argCount - 1] = value;
+    return callValue(value, argCount);
+  }
+
+  Value method;
+  if (!findMethod(instance, name, cache, &method)) return false;
+
+  return call(AS_CLOSURE(method), argCount);
+}
+
+static void bindMethod(Value method) {
+
+  ObjectBoundFunction* bound = newBoundFunction(peek(0), AS_CLOSURE(method));
+  stackPop();
+  stackPush(OBJECT_VALUE(bound));
 }
 
 static bool bindFunction(ObjectClass* cclass, ObjectString* name) {
@@ -226,13 +488,82 @@ static bool bindFunction(ObjectClass* cclass, ObjectString* name) {
     return false;
   }
 
-  ObjectBoundFunction* bound = newBoundFunction(peek(0), AS_CLOSURE(method));
-  stackPop();
-  stackPush(OBJECT_VALUE(bound));
+  bindMethod(method);
+  return true;
+}
 
+static bool getProperty(ObjectString* name, InlineCache* cache) {
+
+  if (!IS_INSTANCE(peek(0))) {
+
+    runtimeError("Only instances have properties.");
+    return false;
+  }
+
+  ObjectInstance* instance = AS_INSTANCE(peek(0));
+  InlineCacheEntry* entry = cacheLookup(cache, instance->shape);
+  if (entry != NULL) {
+
+    if (entry->index != -1) {
+
+      virtualmachine.stackTop[-1] = instance->fields[entry->index];
+    }
+    else {
+
+      bindMethod(entry->method);
+    }
+    return true;
+  }
+
+  Value value;
+  if (findField(instance, name, cache, &value)) {
+
+    virtualmachine.stackTop[-1] = value;
+    return true;
+  }
+
+  Value method;
+  if (!findMethod(instance, name, cache, &method)) return false;
+
+  bindMethod(method);
   return true;
 }
 
+static void setProperty(ObjectInstance* instance, ObjectString* name,
+                        InlineCache* cache, Value value) {
+
+  InlineCacheEntry* entry = cacheLookup(cache, instance->shape);
+  if (entry != NULL && entry->transition == NULL) {
+
+    instance->fields[entry->index] = value;
+    writeBarrier((Object*)instance, value);
+    return;
+  }
+
+  if (entry != NULL && entry->index < instance->capacity) {
+
+    instance->fields[entry->index] = value;
+    instance->shape = (ObjectShape*)entry->transition;
+    writeBarrier((Object*)instance, value);
+    writeBarrier((Object*)instance, OBJECT_VALUE(entry->transition));
+    return;
+  }
+
+  ObjectShape* shape = instance->shape;
+  instanceSetField(instance, name, value);
+  if (instance->shape == NULL) return;
+
+  if (instance->shape == shape) {
+
+    cacheUpdate(cache, shape, NULL, shapeGetIndex(shape, name), NIL_VAL);
+  }
+  else {
+
+    cacheUpdate(cache, shape, instance->shape, instance->shape->count - 1,
+                NIL_VAL);
+  }
+}
+
 static ObjectUpvalue* bindUpvalue(Value* local) {
 
   ObjectUpvalue* prevUpvalue = NULL;
@@ -270,6 +601,7 @@ static void closeUpvalues(Value* last) {
     ObjectUpvalue* upvalue = virtualmachine.openUpvalues;
     upvalue->closed = *upvalue->location;
     upvalue->location = &upvalue->closed;
+    writeBarrier((Object*)upvalue, upvalue->closed);
     virtualmachine.openUpvalues = upvalue->next;
   }
 }
@@ -279,6 +611,8 @@ static void defineBoundFunction(ObjectString* name) {
   Value method = peek(0);
   ObjectClass* cclass = AS_CLASS(peek(1));
   tableSetValue(&cclass->methods, name, method);
+  writeBarrier((Object*)cclass, OBJECT_VALUE(name));
+  writeBarrier((Object*)cclass, method);
   stackPop();
 }
 
@@ -289,16 +623,8 @@ static bool isFalsey(Value value) {
 
 static void concatenate() {
 
-  ObjectString* b = AS_STRING(peek(0));
-  ObjectString* a = AS_STRING(peek(1));
-
-  int size = a->size + b->size;
-  char* chars = ALLOCATE(char, size + 1);
-  memcpy(chars, a->string, a->size);
-  memcpy(chars + a->size, b->string, b->size);
-  chars[size] = '\0';
-
-  ObjectString* result = stringTake(chars, size);
+  ObjectString* result = stringConcatenate(AS_STRING(peek(1)),
+                                           AS_STRING(peek(0)));
   stackPop(); 
   stackPop();
   stackPush(OBJECT_VALUE(result));
@@ -314,10 +640,32 @@ static InterpretResult run() {
     (frame->ip += 2, \
     (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
 
+#define READ_LONG() \
+    (frame->ip += 3, \
+    (uint32_t)((frame->ip[-3] << 16) | (frame->ip[-2] << 8) | frame->ip[-1]))
+
 #define READ_CONSTANT() \
     (frame->closure->function->chunk.constants.values[READ_BYTE()])
 
 #define READ_STRING() AS_STRING(READ_CONSTANT())
+
+#define READ_INDEXED_CONSTANT(longOperation) \
+    (frame->closure->function->chunk.constants.values[ \
+        instruction == longOperation ? READ_LONG() : READ_BYTE()])
+
+#define READ_INDEXED_STRING(longOperation) \
+    AS_STRING(READ_INDEXED_CONSTANT(longOperation))
+
+#define READ_GLOBAL(longOperation) \
+    (instruction == longOperation ? READ_LONG() : READ_SHORT())
+
+#define GLOBAL_NAME(slot) \
+    AS_CSTRING(virtualmachine.globalNames.values[slot])
+
+#define READ_CACHE() \
+    (&frame->closure->function->chunk.caches[READ_SHORT()])
+#define READ_CALLEE() \
+    (&frame->closure->function->chunk.callees[READ_SHORT()])
 #define BINARY_OPERATION(valueType, op) \
     do { \
       if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \
@@ -331,116 +679,318 @@ static InterpretResult run() {
       stackPush(valueType(a op b)); \
     } while (false)
 
-  for (;;) {
+#define COMPARE_JUMP(op, jumpWhen) \
+    do { \
+      uint16_t offset = READ_SHORT(); \
+      if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \
+        \
+        runtimeError("Operands must be numbers."); \
+        return INTERPRET_ERROR_RUNTIME; \
+      } \
+      \
+      double b = AS_NUMBER(stackPop()); \
+      double a = AS_NUMBER(stackPop()); \
+      if ((a op b) == jumpWhen) frame->ip += offset; \
+    } while (false)
 
-#ifndef DEBUG_TRACE_EXECUTION
-  printf("        ");
-  for (Value* slot = virtualmachine.stack; slot < virtualmachine.stackTop; slot++) {
+#define SET_LOCAL_OPERATION(op, readRight) \
+    do { \
+      uint8_t target = READ_BYTE(); \
+      Value a = frame->slots[READ_BYTE()]; \
+      Value b = readRight; \
+      if (!IS_NUMBER(a) || !IS_NUMBER(b)) { \
+        \
+        runtimeError("Operands must be numbers."); \
+        return INTERPRET_ERROR_RUNTIME; \
+      } \
+      \
+      frame->slots[target] = NUMBER_VALUE(AS_NUMBER(a) op AS_NUMBER(b)); \
+    } while (false)
 
-    printf("[ ");
-    valuePrint(*slot);
-    printf(" ]");
-  }
+#define SET_LOCAL_ADDITION(readRight) \
+    do { \
+      uint8_t target = READ_BYTE(); \
+      Value a = frame->slots[READ_BYTE()]; \
+      Value b = readRight; \
+      if (IS_NUMBER(a) && IS_NUMBER(b)) { \
+        \
+        frame->slots[target] = NUMBER_VALUE(AS_NUMBER(a) + AS_NUMBER(b)); \
+      } \
+      else if (IS_STRING(a) && IS_STRING(b)) { \
+        \
+        stackPush(a); \
+        stackPush(b); \
+        concatenate(); \
+        frame->slots[target] = stackPop(); \
+      } \
+      else { \
+        \
+        runtimeError("Operands must be two numbers or two strings."); \
+        return INTERPRET_ERROR_RUNTIME; \
+      } \
+    } while (false)
 
-  printf("\n");
-  dissasembleInstruction(&frame->closure->function->chunk,
-                         (int)(frame->ip - frame->closure->function->chunk.code));
+#define ADDITION_OPERATION() \
+    do { \
+      if (IS_STRING(peek(0)) && IS_STRING(peek(1))) { \
+        \
+        concatenate(); \
+      } \
+      else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) { \
+        \
+        double b = AS_NUMBER(stackPop()); \
+        double a = AS_NUMBER(stackPop()); \
+        stackPush(NUMBER_VALUE(a + b)); \
+      } \
+      else { \
+        \
+        runtimeError("Operands must be two numbers or two strings."); \
+        return INTERPRET_ERROR_RUNTIME; \
+      } \
+    } while (false)
+
+#define QUICKEN(operation) (frame->ip[-1] = (operation))
+
+#define NUMBERS_OPERATION(valueType, op, generic) \
+    do { \
+      Value b = peek(0); \
+      Value a = peek(1); \
+      if (!IS_NUMBER(a) || !IS_NUMBER(b)) { \
+        \
+        QUICKEN(generic); \
+        frame->ip--; \
+        DISPATCH(); \
+      } \
+      \
+      virtualmachine.stackTop--; \
+      virtualmachine.stackTop[-1] = valueType(AS_NUMBER(a) op AS_NUMBER(b)); \
+    } while (false)
+
+#ifdef DEBUG_TRACE_EXECUTION
+#define TRACE_EXECUTION() \
+    do { \
+      printf("        "); \
+      for (Value* slot = virtualmachine.stack; \
+           slot < virtualmachine.stackTop; slot++) { \
+        \
+        printf("[ "); \
+        valuePrint(*slot); \
+        printf(" ]"); \
+      } \
+      \
+      printf("\n"); \
+      instructionDissasemble(&frame->closure->function->chunk, \
+          (int)(frame->ip - frame->closure->function->chunk.code)); \
+    } while (false)
+#else
+#define TRACE_EXECUTION() do { } while (false)
 #endif
 
-    uint8_t instruction;
-    switch (instruction = READ_BYTE()) {
+#ifdef THREADED_DISPATCH
+  static void* dispatchTable[] = {
+    [OPERATION_POP] = &&label_OPERATION_POP,
+    [OPERATION_CONSTANT] = &&label_OPERATION_CONSTANT,
+    [OPERATION_CONSTANT_LONG] = &&label_OPERATION_CONSTANT_LONG,
+    [OPERATION_TRUE] = &&label_OPERATION_TRUE,
+    [OPERATION_FALSE] = &&label_OPERATION_FALSE,
+    [OPERATION_EQUALITY] = &&label_OPERATION_EQUALITY,
+    [OPERATION_GREATER] = &&label_OPERATION_GREATER,
+    [OPERATION_LESS] = &&label_OPERATION_LESS,
+    [OPERATION_ADDITION] = &&label_OPERATION_ADDITION,
+    [OPERATION_SUBTRACTION] = &&label_OPERATION_SUBTRACTION,
+    [OPERATION_MULTIPLICATION] = &&label_OPERATION_MULTIPLICATION,
+    [OPERATION_DIVISION] = &&label_OPERATION_DIVISION,
+    [OPERATION_EXPONENTIATION] = &&label_OPERATION_EXPONENTIATION,
+    [OPERATION_GREATER_NUMBERS] = &&label_OPERATION_GREATER_NUMBERS,
+    [OPERATION_LESS_NUMBERS] = &&label_OPERATION_LESS_NUMBERS,
+    [OPERATION_ADDITION_NUMBERS] = &&label_OPERATION_ADDITION_NUMBERS,
+    [OPERATION_ADDITION_STRINGS] = &&label_OPERATION_ADDITION_STRINGS,
+    [OPERATION_ADDITION_POLYMORPHIC] = &&label_OPERATION_ADDITION_POLYMORPHIC,
+    [OPERATION_SUBTRACTION_NUMBERS] = &&label_OPERATION_SUBTRACTION_NUMBERS,
+    [OPERATION_MULTIPLICATION_NUMBERS] = &&label_OPERATION_MULTIPLICATION_NUMBERS,
+    [OPERATION_DIVISION_NUMBERS] = &&label_OPERATION_DIVISION_NUMBERS,
+    [OPERATION_ADDITION_LOCALS] = &&label_OPERATION_ADDITION_LOCALS,
+    [OPERATION_LESS_LOCAL_CONSTANT] = &&label_OPERATION_LESS_LOCAL_CONSTANT,
+    [OPERATION_GET_LOCAL_PROPERTY] = &&label_OPERATION_GET_LOCAL_PROPERTY,
+    [OPERATION_SET_LOCAL_LOCAL] = &&label_OPERATION_SET_LOCAL_LOCAL,
+    [OPERATION_SET_LOCAL_CONSTANT] = &&label_OPERATION_SET_LOCAL_CONSTANT,
+    [OPERATION_SET_LOCAL_ADDITION] = &&label_OPERATION_SET_LOCAL_ADDITION,
+    [OPERATION_SET_LOCAL_SUBTRACTION] = &&label_OPERATION_SET_LOCAL_SUBTRACTION,
+    [OPERATION_SET_LOCAL_MULTIPLICATION] = &&label_OPERATION_SET_LOCAL_MULTIPLICATION,
+    [OPERATION_SET_LOCAL_DIVISION] = &&label_OPERATION_SET_LOCAL_DIVISION,
+    [OPERATION_SET_LOCAL_ADDITION_CONSTANT] = &&label_OPERATION_SET_LOCAL_ADDITION_CONSTANT,
+    [OPERATION_SET_LOCAL_SUBTRACTION_CONSTANT] = &&label_OPERATION_SET_LOCAL_SUBTRACTION_CONSTANT,
+    [OPERATION_SET_LOCAL_MULTIPLICATION_CONSTANT] = &&label_OPERATION_SET_LOCAL_MULTIPLICATION_CONSTANT,
+    [OPERATION_SET_LOCAL_DIVISION_CONSTANT] = &&label_OPERATION_SET_LOCAL_DIVISION_CONSTANT,
+    [OPERATION_NOT] = &&label_OPERATION_NOT,
+    [OPERATION_NIL] = &&label_OPERATION_NIL,
+    [OPERATION_NEGATION] = &&label_OPERATION_NEGATION,
+    [OPERATION_GET_LOCAL] = &&label_OPERATION_GET_LOCAL,
+    [OPERATION_SET_LOCAL] = &&label_OPERATION_SET_LOCAL,
+    [OPERATION_GET_GLOBAL_SLOT] = &&label_OPERATION_GET_GLOBAL_SLOT,
+    [OPERATION_GET_GLOBAL_SLOT_LONG] = &&label_OPERATION_GET_GLOBAL_SLOT_LONG,
+    [OPERATION_DEFINE_GLOBAL_SLOT] = &&label_OPERATION_DEFINE_GLOBAL_SLOT,
+    [OPERATION_DEFINE_GLOBAL_SLOT_LONG] = &&label_OPERATION_DEFINE_GLOBAL_SLOT_LONG,
+    [OPERATION_SET_GLOBAL_SLOT] = &&label_OPERATION_SET_GLOBAL_SLOT,
+    [OPERATION_SET_GLOBAL_SLOT_LONG] = &&label_OPERATION_SET_GLOBAL_SLOT_LONG,
+    [OPERATION_GET_UPVALUE] = &&label_OPERATION_GET_UPVALUE,
+    [OPERATION_SET_UPVALUE] = &&label_OPERATION_SET_UPVALUE,
+    [OPERATION_GET_PROPERTY] = &&label_OPERATION_GET_PROPERTY,
+    [OPERATION_GET_PROPERTY_LONG] = &&label_OPERATION_GET_PROPERTY_LONG,
+    [OPERATION_SET_PROPERTY] = &&label_OPERATION_SET_PROPERTY,
+    [OPERATION_SET_PROPERTY_LONG] = &&label_OPERATION_SET_PROPERTY_LONG,
+    [OPERATION_GET_SUPER] = &&label_OPERATION_GET_SUPER,
+    [OPERATION_GET_SUPER_LONG] = &&label_OPERATION_GET_SUPER_LONG,
+    [OPERATION_PRINT] = &&label_OPERATION_PRINT,
+    [OPERATION_JUMP] = &&label_OPERATION_JUMP,
+    [OPERATION_JUMP_IF_FALSE] = &&label_OPERATION_JUMP_IF_FALSE,
+    [OPERATION_POP_JUMP_IF_FALSE] = &&label_OPERATION_POP_JUMP_IF_FALSE,
+    [OPERATION_JUMP_IF_EQUAL] = &&label_OPERATION_JUMP_IF_EQUAL,
+    [OPERATION_JUMP_IF_NOT_EQUAL] = &&label_OPERATION_JUMP_IF_NOT_EQUAL,
+    [OPERATION_JUMP_IF_NOT_GREATER] = &&label_OPERATION_JUMP_IF_NOT_GREATER,
+    [OPERATION_JUMP_IF_NOT_GREATER_EQUAL] = &&label_OPERATION_JUMP_IF_NOT_GREATER_EQUAL,
+    [OPERATION_JUMP_IF_NOT_LESS] = &&label_OPERATION_JUMP_IF_NOT_LESS,
+    [OPERATION_JUMP_IF_NOT_LESS_EQUAL] = &&label_OPERATION_JUMP_IF_NOT_LESS_EQUAL,
+    [OPERATION_JUMP_IF_NOT_LESS_LOCAL_CONSTANT] = &&label_OPERATION_JUMP_IF_NOT_LESS_LOCAL_CONSTANT,
+    [OPERATION_LOOP] = &&label_OPERATION_LOOP,
+    [OPERATION_CALL] = &&label_OPERATION_CALL,
+    [OPERATION_CALL_0] = &&label_OPERATION_CALL_0,
+    [OPERATION_CALL_1] = &&label_OPERATION_CALL_1,
+    [OPERATION_CALL_2] = &&label_OPERATION_CALL_2,
+    [OPERATION_CALL_3] = &&label_OPERATION_CALL_3,
+    [OPERATION_INVOKE] = &&label_OPERATION_INVOKE,
+    [OPERATION_INVOKE_LONG] = &&label_OPERATION_INVOKE_LONG,
+    [OPERATION_SUPER_INVOKE] = &&label_OPERATION_SUPER_INVOKE,
+    [OPERATION_SUPER_INVOKE_LONG] = &&label_OPERATION_SUPER_INVOKE_LONG,
+    [OPERATION_CLOSURE] = &&label_OPERATION_CLOSURE,
+    [OPERATION_CLOSURE_LONG] = &&label_OPERATION_CLOSURE_LONG,
+    [OPERATION_CLOSE_UPVALUE] = &&label_OPERATION_CLOSE_UPVALUE,
+    [OPERATION_CLASS] = &&label_OPERATION_CLASS,
+    [OPERATION_CLASS_LONG] = &&label_OPERATION_CLASS_LONG,
+    [OPERATION_INHERIT] = &&label_OPERATION_INHERIT,
+    [OPERATION_BOUND_FUNCTION] = &&label_OPERATION_BOUND_FUNCTION,
+    [OPERATION_BOUND_FUNCTION_LONG] = &&label_OPERATION_BOUND_FUNCTION_LONG,
+    [OPERATION_RETURN] = &&label_OPERATION_RETURN,
+  };
+
+#define DISPATCH_LOOP DISPATCH();
+#define CASE(operation) label_##operation
+#define DISPATCH() \
+    do { \
+      TRACE_EXECUTION(); \
+      goto *dispatchTable[instruction = READ_BYTE()]; \
+    } while (false)
+#else
+#define DISPATCH_LOOP \
+    dispatch: \
+      TRACE_EXECUTION(); \
+      switch (instruction = READ_BYTE())
+#define CASE(operation) case operation
+#define DISPATCH() goto dispatch
+#endif
 
-      case OPERATION_CONSTANT: {
+  uint8_t instruction;
+  DISPATCH_LOOP {
+
+      CASE(OPERATION_CONSTANT): {
 
         Value constant = READ_CONSTANT();
         stackPush(constant);
-        break;
+        DISPATCH();
+      }
+      CASE(OPERATION_CONSTANT_LONG): {
+
+        Value constant =
+            frame->closure->function->chunk.constants.values[READ_LONG()];
+        stackPush(constant);
+        DISPATCH();
       }
-      case OPERATION_NIL:   stackPush(NIL_VAL); break;
-      case OPERATION_TRUE:  stackPush(BOOLEAN_VALUE(true)); break;
-      case OPERATION_FALSE: stackPush(BOOLEAN_VALUE(false)); break;
-      case OPERATION_POP:   stackPop(); break;
-      case OPERATION_GET_LOCAL: {
+      CASE(OPERATION_NIL):   stackPush(NIL_VAL); DISPATCH();
+      CASE(OPERATION_TRUE):  stackPush(BOOLEAN_VALUE(true)); DISPATCH();
+      CASE(OPERATION_FALSE): stackPush(BOOLEAN_VALUE(false)); DISPATCH();
+      CASE(OPERATION_POP):   stackPop(); DISPATCH();
+      CASE(OPERATION_GET_LOCAL): {
 
         uint8_t slot = READ_BYTE();
         stackPush(frame->slots[slot]);
-        break;
+        DISPATCH();
       }
-      case OPERATION_SET_LOCAL: {
+      CASE(OPERATION_SET_LOCAL): {
 
         uint8_t slot = READ_BYTE();
         frame->slots[slot] = peek(0);
-        break;
+        DISPATCH();
       }
-      case OPERATION_GET_GLOBAL: {
+      CASE(OPERATION_GET_GLOBAL_SLOT):
+      CASE(OPERATION_GET_GLOBAL_SLOT_LONG): {
 
-        ObjectString* name = READ_STRING();
-        Value value;
-        if (!tableGetValue(&virtualmachine.globals, name, &value)) {
+        uint32_t slot = READ_GLOBAL(OPERATION_GET_GLOBAL_SLOT_LONG);
+        Value value = virtualmachine.globalValues.values[slot];
+        if (IS_UNDEFINED(value)) {
 
-          runtimeError("Undefined variable '%s'.", name->string);
+          runtimeError("Undefined variable '%s'.", GLOBAL_NAME(slot));
           return INTERPRET_ERROR_RUNTIME;
         }
 
         stackPush(value);
-        break;
+        DISPATCH();
       }
-      case OPERATION_DEFINE_GLOBAL: {
+      CASE(OPERATION_DEFINE_GLOBAL_SLOT):
+      CASE(OPERATION_DEFINE_GLOBAL_SLOT_LONG): {
 
-        ObjectString* name = READ_STRING();
-        tableSetValue(&virtualmachine.globals, name, peek(0));
-        stackPop();
-        break;
+        uint32_t slot = READ_GLOBAL(OPERATION_DEFINE_GLOBAL_SLOT_LONG);
+        virtualmachine.globalValues.values[slot] = stackPop();
+        DISPATCH();
       }
-      case OPERATION_SET_GLOBAL: {
+      CASE(OPERATION_SET_GLOBAL_SLOT):
+      CASE(OPERATION_SET_GLOBAL_SLOT_LONG): {
 
-        ObjectString* name = READ_STRING();
-        if (tableSetValue(&virtualmachine.globals, name, peek(0))) {
+        uint32_t slot = READ_GLOBAL(OPERATION_SET_GLOBAL_SLOT_LONG);
+        if (IS_UNDEFINED(virtualmachine.globalValues.values[slot])) {
 
-          tableRemoveValue(&virtualmachine.globals, name);
-          runtimeError("Undefined variable '%s'.", name->string);
+          runtimeError("Undefined variable '%s'.", GLOBAL_NAME(slot));
           return INTERPRET_ERROR_RUNTIME;
         }
 
-        break;
+        virtualmachine.globalValues.values[slot] = peek(0);
+        DISPATCH();
       }
-      case OPERATION_GET_UPVALUE: {
+      CASE(OPERATION_GET_UPVALUE): {
 
         uint8_t slot = READ_BYTE();
         stackPush(*frame->closure->upvalues[slot]->location);
-        break;
+        DISPATCH();
       }
-      case OPERATION_SET_UPVALUE: {
+      CASE(OPERATION_SET_UPVALUE): {
 
         uint8_t slot = READ_BYTE();
         *frame->closure->upvalues[slot]->location = peek(0);
-        break;
+        writeBarrier((Object*)frame->closure->upvalues[slot], peek(0));
+        DISPATCH();
       }
-      case OPERATION_GET_PROPERTY: {
+      CASE(OPERATION_GET_PROPERTY):
+      CASE(OPERATION_GET_PROPERTY_LONG): {
 
-        if (!IS_INSTANCE(peek(0))) {
+        ObjectString* name = READ_INDEXED_STRING(OPERATION_GET_PROPERTY_LONG);
+        if (!getProperty(name, READ_CACHE())) {
 
-          runtimeError("Only instances have properties.");
           return INTERPRET_ERROR_RUNTIME;
         }
+        DISPATCH();
+      }
+      CASE(OPERATION_GET_LOCAL_PROPERTY): {
 
-        ObjectInstance* instance = AS_INSTANCE(peek(0));
+        uint8_t slot = READ_BYTE();
         ObjectString* name = READ_STRING();
-
-        Value value;
-        if (tableGetValue(&instance->fields, name, &value)) {
-
-          stackPop();
-          stackPush(value);
-          break;
-        }
-        if (!bindFunction(instance->cclass, name)) {
+        stackPush(frame->slots[slot]);
+        if (!getProperty(name, READ_CACHE())) {
 
           return INTERPRET_ERROR_RUNTIME;
         }
-        break;
+        DISPATCH();
       }
-      case OPERATION_SET_PROPERTY: {
+      CASE(OPERATION_SET_PROPERTY):
+      CASE(OPERATION_SET_PROPERTY_LONG): {
 
         if (!IS_INSTANCE(peek(1))) {
 
@@ -449,55 +999,180 @@ static InterpretResult run() {
         }
         
         ObjectInstance* instance = AS_INSTANCE(peek(1));
-        tableSetValue(&instance->fields, READ_STRING(), peek(0));
+        ObjectString* name = READ_INDEXED_STRING(OPERATION_SET_PROPERTY_LONG);
+        setProperty(instance, name, READ_CACHE(), peek(0));
         Value value = stackPop();
         stackPop();
         stackPush(value);
-        break;
+        DISPATCH();
       }
-      case OPERATION_EQUALITY: {
+      CASE(OPERATION_EQUALITY): {
 
         Value b = stackPop();
         Value a = stackPop();
         stackPush(BOOLEAN_VALUE(valuesEqual(a,b)));
-        break;
+        DISPATCH();
       }
-      case OPERATION_GET_SUPER: {
+      CASE(OPERATION_GET_SUPER):
+      CASE(OPERATION_GET_SUPER_LONG): {
 
-        ObjectString* name = READ_STRING();
+        ObjectString* name = READ_INDEXED_STRING(OPERATION_GET_SUPER_LONG);
         ObjectClass* superclass = AS_CLASS(stackPop());
 
         if (!bindFunction(superclass, name)) {
 
           return INTERPRET_ERROR_RUNTIME;
         }
-        break;
+        DISPATCH();
       }
-      case OPERATION_GREATER:  BINARY_OPERATION(BOOLEAN_VALUE, >); break;
-      case OPERATION_LESS:     BINARY_OPERATION(BOOLEAN_VALUE, <); break;
-      case OPERATION_ADDITION: {
+      CASE(OPERATION_GREATER): {
+
+        BINARY_OPERATION(BOOLEAN_VALUE, >);
+        QUICKEN(OPERATION_GREATER_NUMBERS);
+        DISPATCH();
+      }
+      CASE(OPERATION_LESS): {
+
+        BINARY_OPERATION(BOOLEAN_VALUE, <);
+        QUICKEN(OPERATION_LESS_NUMBERS);
+        DISPATCH();
+      }
+      CASE(OPERATION_ADDITION): {
 
         if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
 
-          concatenate();
-        } 
+          QUICKEN(OPERATION_ADDITION_STRINGS);
+        }
         else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
 
-          double b = AS_NUMBER(stackPop());
-          double a = AS_NUMBER(stackPop());
-          stackPush(NUMBER_VALUE(a + b));
-        } 
+          QUICKEN(OPERATION_ADDITION_NUMBERS);
+        }
+
+        ADDITION_OPERATION();
+        DISPATCH();
+      }
+      CASE(OPERATION_ADDITION_POLYMORPHIC):
+        ADDITION_OPERATION();
+        DISPATCH();
+      CASE(OPERATION_SUBTRACTION): {
+
+        BINARY_OPERATION(NUMBER_VALUE, -);
+        QUICKEN(OPERATION_SUBTRACTION_NUMBERS);
+        DISPATCH();
+      }
+      CASE(OPERATION_MULTIPLICATION): {
+
+        BINARY_OPERATION(NUMBER_VALUE, *);
+        QUICKEN(OPERATION_MULTIPLICATION_NUMBERS);
+        DISPATCH();
+      }
+      CASE(OPERATION_DIVISION): {
+
+        BINARY_OPERATION(NUMBER_VALUE, /);
+        QUICKEN(OPERATION_DIVISION_NUMBERS);
+        DISPATCH();
+      }
+      CASE(OPERATION_GREATER_NUMBERS):
+        NUMBERS_OPERATION(BOOLEAN_VALUE, >, OPERATION_GREATER);
+        DISPATCH();
+      CASE(OPERATION_LESS_NUMBERS):
+        NUMBERS_OPERATION(BOOLEAN_VALUE, <, OPERATION_LESS);
+        DISPATCH();
+      CASE(OPERATION_ADDITION_NUMBERS):
+        NUMBERS_OPERATION(NUMBER_VALUE, +, OPERATION_ADDITION_POLYMORPHIC);
+        DISPATCH();
+      CASE(OPERATION_SUBTRACTION_NUMBERS):
+        NUMBERS_OPERATION(NUMBER_VALUE, -, OPERATION_SUBTRACTION);
+        DISPATCH();
+      CASE(OPERATION_MULTIPLICATION_NUMBERS):
+        NUMBERS_OPERATION(NUMBER_VALUE, *, OPERATION_MULTIPLICATION);
+        DISPATCH();
+      CASE(OPERATION_DIVISION_NUMBERS):
+        NUMBERS_OPERATION(NUMBER_VALUE, /, OPERATION_DIVISION);
+        DISPATCH();
+      CASE(OPERATION_ADDITION_LOCALS): {
+
+        Value a = frame->slots[READ_BYTE()];
+        Value b = frame->slots[READ_BYTE()];
+        if (IS_NUMBER(a) && IS_NUMBER(b)) {
+
+          stackPush(NUMBER_VALUE(AS_NUMBER(a) + AS_NUMBER(b)));
+        }
+        else if (IS_STRING(a) && IS_STRING(b)) {
+
+          stackPush(a);
+          stackPush(b);
+          concatenate();
+        }
         else {
 
           runtimeError("Operands must be two numbers or two strings.");
           return INTERPRET_ERROR_RUNTIME;
         }
-        break;
+        DISPATCH();
+      }
+      CASE(OPERATION_LESS_LOCAL_CONSTANT): {
+
+        Value a = frame->slots[READ_BYTE()];
+        Value b = READ_CONSTANT();
+        if (!IS_NUMBER(a) || !IS_NUMBER(b)) {
+
+          runtimeError("Operands must be numbers.");
+          return INTERPRET_ERROR_RUNTIME;
+        }
+
+        stackPush(BOOLEAN_VALUE(AS_NUMBER(a) < AS_NUMBER(b)));
+        DISPATCH();
+      }
+      CASE(OPERATION_SET_LOCAL_LOCAL): {
+
+        uint8_t target = READ_BYTE();
+        frame->slots[target] = frame->slots[READ_BYTE()];
+        DISPATCH();
+      }
+      CASE(OPERATION_SET_LOCAL_CONSTANT): {
+
+        uint8_t target = READ_BYTE();
+        frame->slots[target] = READ_CONSTANT();
+        DISPATCH();
       }
-      case OPERATION_SUBTRACTION:    BINARY_OPERATION(NUMBER_VALUE, -); break;
-      case OPERATION_MULTIPLICATION: BINARY_OPERATION(NUMBER_VALUE, *); break;
-      case OPERATION_DIVISION:       BINARY_OPERATION(NUMBER_VALUE, /); break;
-      case OPERATION_EXPONENTIATION: {
+      CASE(OPERATION_SET_LOCAL_ADDITION):
+        SET_LOCAL_ADDITION(frame->slots[READ_BYTE()]);
+        DISPATCH();
+      CASE(OPERATION_SET_LOCAL_SUBTRACTION):
+        SET_LOCAL_OPERATION(-, frame->slots[READ_BYTE()]);
+        DISPATCH();
+      CASE(OPERATION_SET_LOCAL_MULTIPLICATION):
+        SET_LOCAL_OPERATION(*, frame->slots[READ_BYTE()]);
+        DISPATCH();
+      CASE(OPERATION_SET_LOCAL_DIVISION):
+        SET_LOCAL_OPERATION(/, frame->slots[READ_BYTE()]);
+        DISPATCH();
+      CASE(OPERATION_SET_LOCAL_ADDITION_CONSTANT):
+        SET_LOCAL_ADDITION(READ_CONSTANT());
+        DISPATCH();
+      CASE(OPERATION_SET_LOCAL_SUBTRACTION_CONSTANT):
+        SET_LOCAL_OPERATION(-, READ_CONSTANT());
+        DISPATCH();
+      CASE(OPERATION_SET_LOCAL_MULTIPLICATION_CONSTANT):
+        SET_LOCAL_OPERATION(*, READ_CONSTANT());
+        DISPATCH();
+      CASE(OPERATION_SET_LOCAL_DIVISION_CONSTANT):
+        SET_LOCAL_OPERATION(/, READ_CONSTANT());
+        DISPATCH();
+      CASE(OPERATION_ADDITION_STRINGS): {
+
+        if (!IS_STRING(peek(0)) || !IS_STRING(peek(1))) {
+
+          QUICKEN(OPERATION_ADDITION_POLYMORPHIC);
+          frame->ip--;
+          DISPATCH();
+        }
+
+        concatenate();
+        DISPATCH();
+      }
+      CASE(OPERATION_EXPONENTIATION): {
 
         if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) {
 
@@ -508,14 +1183,14 @@ static InterpretResult run() {
         double b = AS_NUMBER(stackPop());
         double a = AS_NUMBER(stackPop());
         stackPush(NUMBER_VALUE(pow(a, b)));
-        break;
+        DISPATCH();
       }
-      case OPERATION_NOT: {
+      CASE(OPERATION_NOT): {
 
         stackPush(BOOLEAN_VALUE(isFalsey(stackPop())));
-        break;
+        DISPATCH();
       }
-      case OPERATION_NEGATION: {
+      CASE(OPERATION_NEGATION): {
 
         if (!IS_NUMBER(peek(0))) {
 
@@ -524,33 +1199,82 @@ static InterpretResult run() {
         }
 
         stackPush(NUMBER_VALUE(-AS_NUMBER(stackPop())));
-        break;
+        DISPATCH();
       }
-      case OPERATION_PRINT: {
+      CASE(OPERATION_PRINT): {
 
         valuePrint(stackPop());
         printf("\n");
-        break;
+        DISPATCH();
       }
-      case OPERATION_JUMP: {
+      CASE(OPERATION_JUMP): {
 
         uint16_t offset = READ_SHORT();
         frame->ip += offset;
-        break;
+        DISPATCH();
       }
-      case OPERATION_JUMP_IF_FALSE: {
+      CASE(OPERATION_JUMP_IF_FALSE): {
 
         uint16_t offset = READ_SHORT();
         if (isFalsey(peek(0))) frame->ip += offset;
-        break;
+        DISPATCH();
+      }
+      CASE(OPERATION_POP_JUMP_IF_FALSE): {
+
+        uint16_t offset = READ_SHORT();
+        if (isFalsey(stackPop())) frame->ip += offset;
+        DISPATCH();
+      }
+      CASE(OPERATION_JUMP_IF_EQUAL): {
+
+        uint16_t offset = READ_SHORT();
+        Value b = stackPop();
+        Value a = stackPop();
+        if (valuesEqual(a, b)) frame->ip += offset;
+        DISPATCH();
+      }
+      CASE(OPERATION_JUMP_IF_NOT_EQUAL): {
+
+        uint16_t offset = READ_SHORT();
+        Value b = stackPop();
+        Value a = stackPop();
+        if (!valuesEqual(a, b)) frame->ip += offset;
+        DISPATCH();
+      }
+      CASE(OPERATION_JUMP_IF_NOT_GREATER):
+        COMPARE_JUMP(>, false);
+        DISPATCH();
+      CASE(OPERATION_JUMP_IF_NOT_GREATER_EQUAL):
+        COMPARE_JUMP(<, true);
+        DISPATCH();
+      CASE(OPERATION_JUMP_IF_NOT_LESS):
+        COMPARE_JUMP(<, false);
+        DISPATCH();
+      CASE(OPERATION_JUMP_IF_NOT_LESS_EQUAL):
+        COMPARE_JUMP(>, true);
+        DISPATCH();
+      CASE(OPERATION_JUMP_IF_NOT_LESS_LOCAL_CONSTANT): {
+
+        Value a = frame->slots[READ_BYTE()];
+        Value b = READ_CONSTANT();
+        uint16_t offset = READ_SHORT();
+        if (!IS_NUMBER(a) || !IS_NUMBER(b)) {
+
+          runtimeError("Operands must be numbers.");
+          return INTERPRET_ERROR_RUNTIME;
+        }
+
+        if (!(AS_NUMBER(a) < AS_NUMBER(b))) frame->ip += offset;
+        DISPATCH();
       }
-      case OPERATION_LOOP: {
+      CASE(OPERATION_LOOP): {
 
         uint16_t offset = READ_SHORT();
         frame->ip -= offset;
-        break;
+        if (virtualmachine.compactRequested) compactGarbage();
+        DISPATCH();
       }
-      case OPERATION_CALL: {
+      CASE(OPERATION_CALL): {
 
         int argCount = READ_BYTE();
         if (!callValue(peek(argCount), argCount)) {
@@ -559,23 +1283,58 @@ static InterpretResult run() {
         }
 
         frame = &virtualmachine.frames[virtualmachine.frameCount-1];
-        break;
+        DISPATCH();
+      }
+      CASE(OPERATION_CALL_0):
+      CASE(OPERATION_CALL_1):
+      CASE(OPERATION_CALL_2):
+      CASE(OPERATION_CALL_3): {
+
+        int argCount = instruction - OPERATION_CALL_0;
+        Value* cache = READ_CALLEE();
+        Value callee = peek(argCount);
+        if (callee == *cache && IS_OBJECT(callee) &&
+            virtualmachine.frameCount < MAX_FRAMES) {
+
+          ObjectClosure* closure = AS_CLOSURE(callee);
+          frame = &virtualmachine.frames[virtualmachine.frameCount++];
+          frame->closure = closure;
+          frame->ip = closure->function->chunk.code;
+          frame->slots = virtualmachine.stackTop - argCount - 1;
+          DISPATCH();
+        }
+
+        if (!callValue(callee, argCount)) {
+
+          return INTERPRET_ERROR_RUNTIME;
+        }
+
+        if (IS_CLOSURE(callee)) {
+
+          *cache = callee;
+          objectWriteBarrier((Object*)frame->closure->function);
+        }
+        frame = &virtualmachine.frames[virtualmachine.frameCount - 1];
+        DISPATCH();
       }
-      case OPERATION_INVOKE: {
+      CASE(OPERATION_INVOKE):
+      CASE(OPERATION_INVOKE_LONG): {
 
-        ObjectString* method = READ_STRING();
+        ObjectString* method = READ_INDEXED_STRING(OPERATION_INVOKE_LONG);
         int argCount = READ_BYTE();
-        if (!invoke(method, argCount)) {
+        if (!invoke(method, argCount, READ_CACHE())) {
 
           return INTERPRET_ERROR_RUNTIME;
         }
 
         frame = &virtualmachine.frames[virtualmachine.frameCount - 1];
-        break;
+        DISPATCH();
       }
-      case OPERATION_SUPER_INVOKE: {
+      CASE(OPERATION_SUPER_INVOKE):
+      CASE(OPERATION_SUPER_INVOKE_LONG): {
 
-        ObjectString* method = READ_STRING();
+        ObjectString* method =
+            READ_INDEXED_STRING(OPERATION_SUPER_INVOKE_LONG);
         int argCount = READ_BYTE();
         ObjectClass* superclass = AS_CLASS(stackPop());
         if (!invokeFromClass(superclass, method, argCount)) {
@@ -584,11 +1343,13 @@ static InterpretResult run() {
         }
 
         frame = &virtualmachine.frames[virtualmachine.frameCount - 1];
-        break;
+        DISPATCH();
       }
-      case OPERATION_CLOSURE: {
+      CASE(OPERATION_CLOSURE):
+      CASE(OPERATION_CLOSURE_LONG): {
 
-        ObjectFunction* function = AS_FUNCTION(READ_CONSTANT());
+        ObjectFunction* function =
+            AS_FUNCTION(READ_INDEXED_CONSTANT(OPERATION_CLOSURE_LONG));
         ObjectClosure* closure = newClosure(function);
         stackPush(OBJECT_VALUE(closure));
 
@@ -604,17 +1365,18 @@ static InterpretResult run() {
 
             closure->upvalues[i] = frame->closure->upvalues[index];
           }
+          writeBarrier((Object*)closure, OBJECT_VALUE(closure->upvalues[i]));
         }
 
-        break;
+        DISPATCH();
       }
-      case OPERATION_CLOSE_UPVALUE: {
+      CASE(OPERATION_CLOSE_UPVALUE): {
 
         closeUpvalues(virtualmachine.stackTop - 1);
         stackPop();
-        break;
+        DISPATCH();
       }
-      case OPERATION_RETURN: {
+      CASE(OPERATION_RETURN): {
 
         Value result = stackPop();
         closeUpvalues(frame->slots);
@@ -628,14 +1390,17 @@ static InterpretResult run() {
         virtualmachine.stackTop = frame->slots;
         stackPush(result);
         frame = &virtualmachine.frames[virtualmachine.frameCount - 1];
-        break;
+        if (virtualmachine.compactRequested) compactGarbage();
+        DISPATCH();
       }
-      case OPERATION_CLASS: {
+      CASE(OPERATION_CLASS):
+      CASE(OPERATION_CLASS_LONG): {
 
-        stackPush(OBJECT_VALUE(newClass(READ_STRING())));
-        break;
+        ObjectString* name = READ_INDEXED_STRING(OPERATION_CLASS_LONG);
+        stackPush(OBJECT_VALUE(newClass(name)));
+        DISPATCH();
       }
-      case OPERATION_INHERIT: {
+      CASE(OPERATION_INHERIT): {
 
         Value superclass = peek(1);
         if (!IS_CLASS(superclass)) {
@@ -646,28 +1411,83 @@ static InterpretResult run() {
 
         ObjectClass* subclass = AS_CLASS(peek(0));
         tableCopyTo(&AS_CLASS(superclass)->methods, &subclass->methods);
+        objectWriteBarrier((Object*)subclass);
         stackPop();
-        break;
+        DISPATCH();
       }
-      case OPERATION_BOUND_FUNCTION: {
+      CASE(OPERATION_BOUND_FUNCTION):
+      CASE(OPERATION_BOUND_FUNCTION_LONG): {
 
-        defineBoundFunction(READ_STRING());
-        break;
+        defineBoundFunction(
+            READ_INDEXED_STRING(OPERATION_BOUND_FUNCTION_LONG));
+        DISPATCH();
       }
-    }
-  } 
+  }
 
-#undef READ_BYTE;
-#undef READ_SHORT;
-#undef READ_CONSTANT;
-#undef READ_STRING;
-#undef BINARY_OPERATION;
+  // Only reachable from the switch fallback, for an opcode with no case.
+  runtimeError("Unknown operation %d.", instruction);
+  return INTERPRET_ERROR_RUNTIME;
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_CONSTANT
+#undef READ_STRING
+#undef READ_LONG
+#undef READ_INDEXED_CONSTANT
+#undef READ_INDEXED_STRING
+#undef READ_GLOBAL
+#undef READ_CACHE
+#undef READ_CALLEE
+#undef BINARY_OPERATION
+#undef COMPARE_JUMP
+#undef QUICKEN
+#undef ADDITION_OPERATION
+#undef SET_LOCAL_OPERATION
+#undef SET_LOCAL_ADDITION
+#undef NUMBERS_OPERATION
+#undef TRACE_EXECUTION
+#undef DISPATCH_LOOP
+#undef CASE
+#undef DISPATCH
+}
+
+void heapExhausted() {
+
+  if (!hasErrorHandler) {
+
+    fprintf(stderr, "Out of memory.\n");
+    exit(1);
+  }
+
+  if (virtualmachine.heapLimit > 0) {
+
+    runtimeError("Out of memory: heap limit of %zu bytes reached.",
+                 virtualmachine.heapLimit);
+  }
+  else {
+
+    runtimeError("Out of memory.");
+  }
+
+  longjmp(errorHandler, 1);
 }
 
 InterpretResult interpret(const char* input) {
 
+  if (setjmp(errorHandler) != 0) {
+
+    hasErrorHandler = false;
+    compilerAbort();
+    return INTERPRET_ERROR_RUNTIME;
+  }
+
+  hasErrorHandler = true;
   ObjectFunction* function = compile(input);
-  if (function == NULL) return INTERPRET_ERROR_COMPILE;
+  if (function == NULL) {
+
+    hasErrorHandler = false;
+    return INTERPRET_ERROR_COMPILE;
+  }
 
   stackPush(OBJECT_VALUE(function));
   ObjectClosure* closure = newClosure(function);
@@ -675,5 +1495,7 @@ InterpretResult interpret(const char* input) {
   stackPush(OBJECT_VALUE(closure));
   call(closure, 0);
 
-  return run();
+  InterpretResult result = run();
+  hasErrorHandler = false;
+  return result;
 }
\ No newline at end of file
@@ -1,12 +1,18 @@
 #ifndef tango_virtualmachine_h
 #define tango_virtualmachine_h
 
+#include <time.h>
+
 #include "object.h"
 #include "table.h"
 #include "value.h"
 
 #define MAX_FRAMES 64
 #define STACK_MAX_LOAD (MAX_FRAMES * UINT8_COUNT)
+#define GARBAGE_COLLECTOR_MAX_MARKERS 64
+#define GARBAGE_COLLECTOR_HEAP_SIZE_MULTIPLIER 2
+#define GARBAGE_COLLECTOR_DEFAULT_SLICE 1024
+#define GARBAGE_COLLECTOR_PAUSE_BUCKETS 6
 
 typedef struct {
   ObjectClosure* closure;
@@ -14,22 +20,65 @@ typedef struct {
   Value* slots;
 } CallFrame;
 
+typedef enum {
+  GARBAGE_COLLECTOR_IDLE,
+  GARBAGE_COLLECTOR_YOUNG,
+  GARBAGE_COLLECTOR_MARK,
+  GARBAGE_COLLECTOR_SWEEP,
+} GarbageCollectorPhase;
+
+typedef struct {
+  uint64_t minorCollections;
+  uint64_t majorCollections;
+  uint64_t compactions;
+  uint64_t pauses;
+  double pauseTotal;
+  double pauseMax;
+  uint64_t pauseHistogram[GARBAGE_COLLECTOR_PAUSE_BUCKETS];
+  size_t bytesFreed;
+  size_t peakBytes;
+} GarbageCollectorStats;
+
 typedef struct {
   CallFrame frames[MAX_FRAMES];
   int frameCount;
   Value stack[STACK_MAX_LOAD];
   Value* stackTop;
-  Table globals;
+  Table globalSlots;
+  ValueArray globalNames;
+  ValueArray globalValues;
   Table strings;
+  uint64_t hashSeed;
   ObjectString* initString;
   ObjectUpvalue* openUpvalues;
 
   size_t bytesAllocated;
+  size_t youngBytes;
   size_t nextGC;
-  Object* objects;
+  GarbageCollectorPhase gcPhase;
+  int gcSliceBudget;
+  int gcMarkers;
+  int gcTargetShare;
+  long gcPauseTarget;
+  double gcMultiplier;
+  size_t heapLimit;
+  clock_t gcTime;
+  clock_t gcCycleStart;
+  GarbageCollectorStats gcStats;
+  int gcCompactThreshold;
+  bool compactRequested;
+  int youngCount;
+  int youngCapacity;
+  Object** youngObjects;
   int grayCount;
   int grayCapacity;
   Object** grayStack;
+  int rememberedCount;
+  int rememberedCapacity;
+  Object** rememberedSet;
+  int sliceCount;
+  int sliceCapacity;
+  Object** slices;
 } VirtualMachine;
 
 typedef enum {
@@ -43,6 +92,8 @@ extern VirtualMachine virtualmachine;
 void initVirtualMachine();
 void freeVirtualMachine();
 InterpretResult interpret(const char* input);
+int globalSlot(ObjectString* name);
+void heapExhausted();
 void stackPush(Value value);
 Value stackPop();
 